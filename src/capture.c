@@ -0,0 +1,183 @@
+/* Control and audio capture for reproducing production CPU spikes
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+
+#define CAPTURE_FLUSH_INTERVAL_NS (20 * 1000 * 1000)
+
+struct capture {
+    /* ring of ring_size bytes, ring_size is a power of two. head is only
+     * written by the audio thread, tail only by the writer thread */
+    unsigned char *ring;
+    unsigned long ring_size;
+    unsigned long head;
+    unsigned long tail;
+    uint32_t dropped;
+
+    int num_controls;
+
+    FILE *file;
+    pthread_t thread;
+    int running;
+};
+
+static uint64_t capture_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void ring_put(struct capture *cap, unsigned long pos, const void *data, unsigned long len)
+{
+    unsigned long offset = pos & (cap->ring_size - 1);
+    unsigned long first = cap->ring_size - offset;
+
+    if (first > len) first = len;
+    memcpy(cap->ring + offset, data, first);
+    memcpy(cap->ring, (const unsigned char *)data + first, len - first);
+}
+
+/* Write everything up to the current head to the file. Only called from
+ * the writer thread or after it has been stopped. */
+static void capture_flush(struct capture *cap)
+{
+    unsigned long head = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+    unsigned long tail = cap->tail;
+    unsigned long offset, len;
+
+    while (tail != head) {
+        offset = tail & (cap->ring_size - 1);
+        len = head - tail;
+        if (len > cap->ring_size - offset)
+            len = cap->ring_size - offset;
+        fwrite(cap->ring + offset, 1, len, cap->file);
+        tail += len;
+    }
+    fflush(cap->file);
+
+    __atomic_store_n(&cap->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void *capture_thread(void *arg)
+{
+    struct capture *cap = (struct capture *)arg;
+    struct timespec ts = { 0, CAPTURE_FLUSH_INTERVAL_NS };
+
+    while (__atomic_load_n(&cap->running, __ATOMIC_ACQUIRE)) {
+        nanosleep(&ts, NULL);
+        capture_flush(cap);
+    }
+    return NULL;
+}
+
+struct capture *capture_open(const char *path, unsigned long sample_rate,
+        int num_controls, unsigned long ring_size)
+{
+    struct capture *cap;
+    struct capture_file_header header;
+    unsigned long size = 4096;
+
+    while (size < ring_size)
+        size <<= 1;
+
+    cap = malloc(sizeof(struct capture));
+    if (cap == NULL) return NULL;
+    memset(cap, 0, sizeof(struct capture));
+
+    cap->num_controls = num_controls;
+    cap->ring_size = size;
+    cap->ring = malloc(size);
+    if (cap->ring == NULL) goto error;
+    /* touch the ring now so the audio thread doesn't take the page faults */
+    memset(cap->ring, 0, size);
+
+    cap->file = fopen(path, "wb");
+    if (cap->file == NULL) goto error;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.sample_rate = sample_rate;
+    header.num_controls = num_controls;
+    fwrite(&header, sizeof(header), 1, cap->file);
+
+    cap->running = 1;
+    if (pthread_create(&cap->thread, NULL, capture_thread, cap)) {
+        cap->running = 0;
+        goto error;
+    }
+
+    return cap;
+
+error:
+    if (cap->file) fclose(cap->file);
+    free(cap->ring);
+    free(cap);
+    return NULL;
+}
+
+void capture_close(struct capture *cap)
+{
+    if (cap == NULL) return;
+
+    __atomic_store_n(&cap->running, 0, __ATOMIC_RELEASE);
+    pthread_join(cap->thread, NULL);
+    capture_flush(cap);
+
+    fclose(cap->file);
+    free(cap->ring);
+    free(cap);
+}
+
+static void capture_record(struct capture *cap, uint32_t type, const float *controls,
+        const float *input, unsigned long sample_count, uint32_t flags, float adding_gain)
+{
+    struct capture_record rec;
+    unsigned long controls_len = cap->num_controls * sizeof(float);
+    unsigned long input_len = sample_count * sizeof(float);
+    unsigned long len = sizeof(rec) + controls_len + input_len;
+    unsigned long head = cap->head;
+    unsigned long tail = __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE);
+
+    if (len > cap->ring_size - (head - tail)) {
+        cap->dropped++;
+        return;
+    }
+
+    rec.type = type;
+    rec.size = len;
+    rec.time_ns = capture_now_ns();
+    rec.sample_count = sample_count;
+    rec.flags = flags;
+    rec.dropped = cap->dropped;
+    rec.adding_gain = adding_gain;
+    cap->dropped = 0;
+
+    ring_put(cap, head, &rec, sizeof(rec));
+    ring_put(cap, head + sizeof(rec), controls, controls_len);
+    if (input_len)
+        ring_put(cap, head + sizeof(rec) + controls_len, input, input_len);
+
+    __atomic_store_n(&cap->head, head + len, __ATOMIC_RELEASE);
+}
+
+void capture_activate(struct capture *cap, const float *controls)
+{
+    capture_record(cap, CAPTURE_ACTIVATE, controls, NULL, 0, 0, 0);
+}
+
+void capture_block(struct capture *cap, const float *controls, const float *input,
+        unsigned long sample_count, int add, float adding_gain)
+{
+    capture_record(cap, CAPTURE_BLOCK, controls, input, sample_count,
+            add ? CAPTURE_FLAG_ADDING : 0, adding_gain);
+}
@@ -0,0 +1,58 @@
+/* Control and audio capture for reproducing production CPU spikes
+ *
+ * The audio thread copies each block's input samples and control port values
+ * into a preallocated single-producer/single-consumer ring. A writer thread
+ * drains the ring into a binary file that the benchmark can replay.
+ *
+ * File layout (native byte order):
+ *   struct capture_file_header
+ *   struct capture_record, followed by num_controls floats, the control
+ *   values indexed by port number, and, for CAPTURE_BLOCK records,
+ *   sample_count input samples
+ *   ...
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_CAPTURE_H
+#define SYMP_CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC "SYMPCAP1"
+#define CAPTURE_VERSION (2)
+
+#define CAPTURE_ACTIVATE (1)
+#define CAPTURE_BLOCK (2)
+
+#define CAPTURE_FLAG_ADDING (1 << 0)
+
+struct capture_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_rate;
+    uint32_t num_controls;
+    uint32_t reserved;
+};
+
+struct capture_record {
+    uint32_t type;
+    uint32_t size;          /* total record size in bytes, including this header */
+    uint64_t time_ns;       /* CLOCK_MONOTONIC when the block started */
+    uint32_t sample_count;
+    uint32_t flags;
+    uint32_t dropped;       /* records dropped since the previous one, ring was full */
+    float adding_gain;
+};
+
+struct capture;
+
+struct capture *capture_open(const char *path, unsigned long sample_rate,
+        int num_controls, unsigned long ring_size);
+void capture_close(struct capture *cap);
+
+void capture_activate(struct capture *cap, const float *controls);
+void capture_block(struct capture *cap, const float *controls, const float *input,
+        unsigned long sample_count, int add, float adding_gain);
+
+#endif
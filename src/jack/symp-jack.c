@@ -0,0 +1,378 @@
+/* Headless JACK client for the sympathetic string resonator
+ *
+ * Runs the comb engine (see symp_core.h) directly in the JACK process
+ * callback, without an intermediate plugin host. The comb bank is set up
+ * before the client is activated, the process callback only hands the
+ * parameters to the core and processes the block, it never allocates.
+ *
+ * SIGUSR1 toggles freezing the strings, see symp_core_params.freeze.
+ *
+ * With -x, an internal test signal replaces the input port and the client
+ * exits with a non-zero status if the output was silent or not finite, for
+ * testing against the dummy backend (make jack-test).
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <jack/jack.h>
+
+#include "../symp_core.h"
+
+struct jack_opts {
+    const char *name;
+    float tunings[SYMP_CORE_MAX_STRINGS];
+    struct symp_core_params params;
+    int autoconnect;
+    float duration;
+    int test_signal;
+    int decimation;
+    int engine;
+};
+
+struct symp_jack {
+    jack_client_t *client;
+    jack_port_t *input;
+    jack_port_t *output1;
+    jack_port_t *output2;
+
+    struct symp_core *core;
+    struct symp_core_params params;
+
+    /* internal test signal, see -x */
+    int test_signal;
+    unsigned int noise;
+    unsigned long pos;
+    unsigned long burst_len;
+    unsigned long period;
+    float *test_buf;
+
+    /* updated by the process thread, read after deactivation */
+    unsigned long blocks;
+    unsigned long non_finite;
+    float peak;
+    volatile int xruns;
+};
+
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t frozen = 0;
+
+static void symp_jack_signal(int sig)
+{
+    running = 0;
+}
+
+static void symp_jack_freeze(int sig)
+{
+    frozen = !frozen;
+}
+
+static void symp_jack_shutdown(void *arg)
+{
+    running = 0;
+}
+
+static int symp_jack_xrun(void *arg)
+{
+    struct symp_jack *sj = arg;
+    sj->xruns++;
+    return 0;
+}
+
+/* A 50 ms noise burst once per second */
+static void symp_jack_fill_test(struct symp_jack *sj, float *buf, jack_nframes_t nframes)
+{
+    jack_nframes_t i;
+
+    for (i = 0; i < nframes; i++) {
+        sj->noise ^= sj->noise << 13;
+        sj->noise ^= sj->noise >> 17;
+        sj->noise ^= sj->noise << 5;
+        if (sj->pos < sj->burst_len)
+            buf[i] = (float)sj->noise / 2147483648.0f - 1.0f;
+        else
+            buf[i] = 0.0f;
+        if (++sj->pos >= sj->period) sj->pos = 0;
+    }
+}
+
+static int symp_jack_process(jack_nframes_t nframes, void *arg)
+{
+    struct symp_jack *sj = arg;
+    float *in = jack_port_get_buffer(sj->input, nframes);
+    float *out1 = jack_port_get_buffer(sj->output1, nframes);
+    float *out2 = jack_port_get_buffer(sj->output2, nframes);
+    float sum = 0.0f;
+    jack_nframes_t i;
+
+    if (sj->test_signal) {
+        symp_jack_fill_test(sj, sj->test_buf, nframes);
+        in = sj->test_buf;
+    }
+
+    sj->params.freeze = frozen;
+    symp_core_set_params(sj->core, &sj->params);
+    symp_core_process(sj->core, in, out1, out2, nframes);
+
+    if (sj->test_signal) {
+        for (i = 0; i < nframes; i++) {
+            sum += out1[i] + out2[i];
+            sj->peak = fmaxf(sj->peak, fabsf(out1[i]));
+        }
+        if (!isfinite(sum)) sj->non_finite++;
+    }
+    sj->blocks++;
+
+    return 0;
+}
+
+/* Connects the input to the first physical capture port and the outputs
+ * to the first two physical playback ports */
+static void symp_jack_autoconnect(struct symp_jack *sj)
+{
+    const char **ports;
+
+    ports = jack_get_ports(sj->client, NULL, JACK_DEFAULT_AUDIO_TYPE,
+            JackPortIsPhysical | JackPortIsOutput);
+    if (ports && ports[0])
+        jack_connect(sj->client, ports[0], jack_port_name(sj->input));
+    jack_free(ports);
+
+    ports = jack_get_ports(sj->client, NULL, JACK_DEFAULT_AUDIO_TYPE,
+            JackPortIsPhysical | JackPortIsInput);
+    if (ports && ports[0]) {
+        jack_connect(sj->client, jack_port_name(sj->output1), ports[0]);
+        if (ports[1])
+            jack_connect(sj->client, jack_port_name(sj->output2), ports[1]);
+    }
+    jack_free(ports);
+}
+
+/* Comma separated values, one per string, the missing ones are 0 */
+static int parse_list(const char *list, float *values)
+{
+    char *end;
+    int i;
+
+    memset(values, 0, SYMP_CORE_MAX_STRINGS * sizeof(float));
+    for (i = 0; i < SYMP_CORE_MAX_STRINGS && *list; i++) {
+        values[i] = strtof(list, &end);
+        if (end == list) return -1;
+        list = *end == ',' ? end + 1 : end;
+    }
+    return *list ? -1 : 0;
+}
+
+/* LOW,HIGH cutoffs of the band-pass in Hz */
+static int parse_bandpass(const char *arg, struct symp_core_params *params)
+{
+    char *end;
+
+    params->bandpass_low = strtof(arg, &end);
+    if (end == arg || *end != ',') return -1;
+    arg = end + 1;
+    params->bandpass_high = strtof(arg, &end);
+    return end == arg || *end ? -1 : 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n NAME   JACK client name (default sympathetic)\n"
+            "  -t LIST   comma separated string tunings in Hz\n"
+            "            (default 262,294,330,349,392,440,494)\n"
+            "  -f VALUE  feedback, 0 to 1 (default 0.5)\n"
+            "  -d VALUE  damping, 0 to 1 (default 0)\n"
+            "  -F LIST   comma separated feedback of each string, instead of -f\n"
+            "  -T SECS   time for every string to decay by 60 dB, instead of -f\n"
+            "  -g VALUE  input gain (default 0.015)\n"
+            "  -L VALUE  wet left, 0 to 1 (default 1)\n"
+            "  -R VALUE  wet right, 0 to 1 (default 1)\n"
+            "  -D FACTOR run the strings at 1/FACTOR of the rate, 1, 2 or 4 (default 1)\n"
+            "  -b LOW,HIGH band-pass cutoffs in Hz, 0 for none (default 100,20000)\n"
+            "  -B MODE   band-pass on the input (1), in the feedback path (2) or\n"
+            "            both (3), 0 for off (default 0)\n"
+            "  -l        let the strings ring out as loops once the input is silent\n"
+            "  -m        use the modal string engine instead of the combs\n"
+            "  -c        connect to the physical capture and playback ports\n"
+            "  -s SECS   exit after the given time\n"
+            "  -x        process an internal test signal and check the output\n"
+            "SIGUSR1 freezes the strings, and releases them again.\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    struct jack_opts opts = {
+        .name = "sympathetic",
+        .decimation = 1,
+        .tunings = {262, 294, 330, 349, 392, 440, 494},
+        .params = {
+            .feedback = 0.5f,
+            .damping = 0.0f,
+            .input_gain = 0.015f,
+            .wet_left = 1.0f,
+            .wet_right = 1.0f,
+            .bandpass_low = 100.0f,
+            .bandpass_high = 20000.0f,
+        },
+    };
+    struct symp_core_config config;
+    struct symp_jack sj;
+    jack_status_t status;
+    float elapsed = 0;
+    int opt, i, ret = 0;
+
+    while ((opt = getopt(argc, argv, "n:t:f:d:F:T:g:L:R:D:b:B:lmcs:xh")) != -1) {
+        switch (opt) {
+            case 'n': opts.name = optarg; break;
+            case 't':
+                if (parse_list(optarg, opts.tunings) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'f': opts.params.feedback = atof(optarg); break;
+            case 'd': opts.params.damping = atof(optarg); break;
+            case 'F':
+                if (parse_list(optarg, opts.params.string_feedback) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                opts.params.decay = SYMP_CORE_DECAY_STRINGS;
+                break;
+            case 'T':
+                opts.params.rt60 = atof(optarg);
+                opts.params.decay = SYMP_CORE_DECAY_RT60;
+                break;
+            case 'g': opts.params.input_gain = atof(optarg); break;
+            case 'L': opts.params.wet_left = atof(optarg); break;
+            case 'R': opts.params.wet_right = atof(optarg); break;
+            case 'D': opts.decimation = atoi(optarg); break;
+            case 'b':
+                if (parse_bandpass(optarg, &opts.params) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'B': opts.params.bandpass = atoi(optarg) & 3; break;
+            case 'l': opts.params.tail = 1; break;
+            case 'm': opts.engine = SYMP_CORE_ENGINE_MODAL; break;
+            case 'c': opts.autoconnect = 1; break;
+            case 's': opts.duration = atof(optarg); break;
+            case 'x': opts.test_signal = 1; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    /* all strings share the damping of -d */
+    for (i = 0; i < SYMP_CORE_MAX_STRINGS; i++) {
+        opts.params.string_damping[i] = opts.params.damping;
+    }
+
+    memset(&sj, 0, sizeof(sj));
+    sj.params = opts.params;
+    sj.test_signal = opts.test_signal;
+    sj.noise = 1;
+
+    sj.client = jack_client_open(opts.name, JackNoStartServer, &status);
+    if (sj.client == NULL) {
+        fprintf(stderr, "Unable to connect to the JACK server (status 0x%x)\n", status);
+        return 1;
+    }
+
+    sj.input = jack_port_register(sj.client, "in", JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+    sj.output1 = jack_port_register(sj.client, "out_left", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    sj.output2 = jack_port_register(sj.client, "out_right", JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+    if (sj.input == NULL || sj.output1 == NULL || sj.output2 == NULL) {
+        fprintf(stderr, "Unable to register ports\n");
+        jack_client_close(sj.client);
+        return 1;
+    }
+
+    /* everything the process callback needs is allocated up front */
+    memcpy(config.tunings, opts.tunings, sizeof(config.tunings));
+    sj.core = symp_core_create(jack_get_sample_rate(sj.client));
+    if (sj.core && symp_core_set_decimation(sj.core, opts.decimation) < 0) {
+        fprintf(stderr, "Unsupported decimation %d\n", opts.decimation);
+        symp_core_destroy(sj.core);
+        jack_client_close(sj.client);
+        return 1;
+    }
+    if (sj.core && symp_core_set_engine(sj.core, opts.engine) < 0) {
+        fprintf(stderr, "The modal engine is not available in this build\n");
+        symp_core_destroy(sj.core);
+        jack_client_close(sj.client);
+        return 1;
+    }
+    if (sj.core == NULL || symp_core_configure(sj.core, &config) < 0) {
+        fprintf(stderr, "Out of memory!\n");
+        symp_core_destroy(sj.core);
+        jack_client_close(sj.client);
+        return 1;
+    }
+    symp_core_set_params(sj.core, &sj.params);
+
+    if (sj.test_signal) {
+        sj.period = jack_get_sample_rate(sj.client);
+        sj.burst_len = sj.period / 20;
+        /* the maximum block size of JACK 1 and 2 */
+        sj.test_buf = calloc(8192, sizeof(float));
+        if (sj.test_buf == NULL || jack_get_buffer_size(sj.client) > 8192) {
+            fprintf(stderr, "Unable to set up the test signal\n");
+            ret = 1;
+            goto out;
+        }
+    }
+
+    jack_set_process_callback(sj.client, symp_jack_process, &sj);
+    jack_set_xrun_callback(sj.client, symp_jack_xrun, &sj);
+    jack_on_shutdown(sj.client, symp_jack_shutdown, &sj);
+
+    signal(SIGINT, symp_jack_signal);
+    signal(SIGTERM, symp_jack_signal);
+    signal(SIGUSR1, symp_jack_freeze);
+
+    if (jack_activate(sj.client)) {
+        fprintf(stderr, "Unable to activate the JACK client\n");
+        ret = 1;
+        goto out;
+    }
+    if (opts.autoconnect)
+        symp_jack_autoconnect(&sj);
+
+    printf("%s running at %u Hz, block size %u\n", opts.name,
+            jack_get_sample_rate(sj.client), jack_get_buffer_size(sj.client));
+
+    while (running && (opts.duration <= 0 || elapsed < opts.duration)) {
+        usleep(100000);
+        elapsed += 0.1f;
+    }
+
+    printf("DSP load %.1f%%\n", jack_cpu_load(sj.client));
+    jack_deactivate(sj.client);
+
+    printf("%lu blocks, %d xruns\n", sj.blocks, sj.xruns);
+    if (sj.test_signal) {
+        printf("output peak %.4f, %lu blocks with non-finite output\n",
+                sj.peak, sj.non_finite);
+        if (sj.blocks == 0 || sj.peak <= 0 || sj.non_finite)
+            ret = 1;
+    }
+
+out:
+    jack_client_close(sj.client);
+    symp_core_destroy(sj.core);
+    free(sj.test_buf);
+    return ret;
+}
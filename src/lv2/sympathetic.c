@@ -0,0 +1,490 @@
+/* Sympathetic String Reverb LV2 plugin
+ *
+ * The same comb engine as the LADSPA plugin (see symp_core.h), with the
+ * string tunings moved from control ports to the plugin state. Strings are
+ * retuned with symp:Tuning messages on the control port. The new comb bank
+ * is allocated in the host's worker thread and posted to the core (see
+ * symp_core_post()), which crossfades to it at the start of a block, so
+ * retuning never allocates in run(). The tunings of a restored state take
+ * the same way, and the worker also frees the replaced banks. Without a
+ * worker, tuning messages are ignored and the tunings can only change
+ * through state restore.
+ *
+ * Block length options from the host are accepted but not needed, the comb
+ * bank works with any block size.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lv2/core/lv2.h>
+#include <lv2/atom/atom.h>
+#include <lv2/atom/util.h>
+#include <lv2/urid/urid.h>
+#include <lv2/options/options.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/state/state.h>
+#include <lv2/worker/worker.h>
+
+#include "../symp_core.h"
+
+#define SYMP_URI "http://midigurdy.com/lv2/sympathetic"
+#define SYMP_PREFIX SYMP_URI "#"
+
+#define SYMP__Tuning SYMP_PREFIX "Tuning"
+#define SYMP__string SYMP_PREFIX "string"
+#define SYMP__frequency SYMP_PREFIX "frequency"
+#define SYMP__tunings SYMP_PREFIX "tunings"
+
+#define PORT_FEEDBACK (0)
+#define PORT_DAMPING (1)
+#define PORT_GAIN_INPUT (2)
+#define PORT_WET_LEFT (3)
+#define PORT_WET_RIGHT (4)
+#define PORT_CONTROL (5)
+#define PORT_INPUT (6)
+#define PORT_OUTPUT1 (7)
+#define PORT_OUTPUT2 (8)
+#define PORT_BANDPASS_LOW (9)
+#define PORT_BANDPASS_HIGH (10)
+#define PORT_BANDPASS_MODE (11)
+#define PORT_DECAY_TIME (12)
+#define PORT_EQUAL_DECAY (13)
+#define PORT_FREEZE (14)
+#define PORT_TAIL (15)
+
+/* worker messages */
+#define WORK_CONFIGURE (1)
+#define WORK_COLLECT (2)
+
+struct work {
+    int type;
+    float tunings[SYMP_CORE_MAX_STRINGS];
+};
+
+struct urids {
+    LV2_URID atom_float;
+    LV2_URID atom_int;
+    LV2_URID atom_object;
+    LV2_URID atom_blank;
+    LV2_URID atom_vector;
+    LV2_URID max_block;
+    LV2_URID nominal_block;
+    LV2_URID tuning;
+    LV2_URID string;
+    LV2_URID frequency;
+    LV2_URID tunings;
+};
+
+struct symp_lv2
+{
+    float *ctrl_feedback;
+    float *ctrl_damping;
+    float *ctrl_gain_input;
+    float *ctrl_wet_left;
+    float *ctrl_wet_right;
+    float *ctrl_bandpass_low;
+    float *ctrl_bandpass_high;
+    float *ctrl_bandpass_mode;
+    float *ctrl_decay_time;
+    float *ctrl_equal_decay;
+    float *ctrl_freeze;
+    float *ctrl_tail;
+    const LV2_Atom_Sequence *control;
+    const float *audio_input;
+    float *audio_output1;
+    float *audio_output2;
+
+    struct symp_core *core;
+
+    /* the parameters of the last block, those without a port (the per
+     * string feedback and damping) stay 0 */
+    struct symp_core_params params;
+
+    /* the tunings of the last configure request, saved with the state */
+    float tunings[SYMP_CORE_MAX_STRINGS];
+
+    /* the tunings changed, or posting them failed, and run() has to
+     * schedule a WORK_CONFIGURE */
+    int retune;
+
+    /* a WORK_COLLECT request is scheduled and not answered yet */
+    int collecting;
+
+    double sample_rate;
+    int max_block;
+    int nominal_block;
+
+    LV2_URID_Map *map;
+    LV2_Worker_Schedule *schedule;
+    struct urids urids;
+};
+
+/* same defaults as the LADSPA plugin */
+static const float default_tunings[SYMP_CORE_MAX_STRINGS] = {
+    262, 294, 330, 349, 392, 440, 494, 0, 0, 0, 0
+};
+
+static void symp_lv2_map_urids(struct symp_lv2 *symp)
+{
+    LV2_URID_Map *map = symp->map;
+    struct urids *u = &symp->urids;
+
+    u->atom_float = map->map(map->handle, LV2_ATOM__Float);
+    u->atom_int = map->map(map->handle, LV2_ATOM__Int);
+    u->atom_object = map->map(map->handle, LV2_ATOM__Object);
+    u->atom_blank = map->map(map->handle, LV2_ATOM__Blank);
+    u->atom_vector = map->map(map->handle, LV2_ATOM__Vector);
+    u->max_block = map->map(map->handle, LV2_BUF_SIZE__maxBlockLength);
+    u->nominal_block = map->map(map->handle, LV2_BUF_SIZE__nominalBlockLength);
+    u->tuning = map->map(map->handle, SYMP__Tuning);
+    u->string = map->map(map->handle, SYMP__string);
+    u->frequency = map->map(map->handle, SYMP__frequency);
+    u->tunings = map->map(map->handle, SYMP__tunings);
+}
+
+static uint32_t symp_lv2_options_set(LV2_Handle handle, const LV2_Options_Option *options)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    const LV2_Options_Option *o;
+
+    for (o = options; o && o->key; o++) {
+        if (o->type != symp->urids.atom_int) continue;
+
+        if (o->key == symp->urids.max_block)
+            symp->max_block = *(const int32_t *)o->value;
+        else if (o->key == symp->urids.nominal_block)
+            symp->nominal_block = *(const int32_t *)o->value;
+    }
+    return LV2_OPTIONS_SUCCESS;
+}
+
+static uint32_t symp_lv2_options_get(LV2_Handle handle, LV2_Options_Option *options)
+{
+    return LV2_OPTIONS_ERR_BAD_KEY;
+}
+
+static LV2_Handle symp_lv2_instantiate(const LV2_Descriptor *desc, double sample_rate,
+        const char *bundle_path, const LV2_Feature *const *features)
+{
+    struct symp_lv2 *symp;
+    struct symp_core_config config;
+    const LV2_Options_Option *options = NULL;
+    int i;
+
+    symp = malloc(sizeof(struct symp_lv2));
+    if (symp == NULL) return NULL;
+    memset(symp, 0, sizeof(struct symp_lv2));
+
+    for (i = 0; features[i]; i++) {
+        if (!strcmp(features[i]->URI, LV2_URID__map))
+            symp->map = features[i]->data;
+        else if (!strcmp(features[i]->URI, LV2_WORKER__schedule))
+            symp->schedule = features[i]->data;
+        else if (!strcmp(features[i]->URI, LV2_OPTIONS__options))
+            options = features[i]->data;
+    }
+    if (symp->map == NULL) {
+        free(symp);
+        return NULL;
+    }
+    symp_lv2_map_urids(symp);
+    symp_lv2_options_set(symp, options);
+
+    symp->sample_rate = sample_rate;
+    symp->core = symp_core_create(sample_rate);
+    memcpy(symp->tunings, default_tunings, sizeof(symp->tunings));
+    memcpy(config.tunings, symp->tunings, sizeof(config.tunings));
+    if (symp->core == NULL || symp_core_configure(symp->core, &config) < 0) {
+        symp_core_destroy(symp->core);
+        free(symp);
+        return NULL;
+    }
+
+    return symp;
+}
+
+static void symp_lv2_cleanup(LV2_Handle handle)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+
+    symp_core_destroy(symp->core);
+    free(symp);
+}
+
+static void symp_lv2_activate(LV2_Handle handle)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    symp_core_reset(symp->core);
+}
+
+static void symp_lv2_connect_port(LV2_Handle handle, uint32_t port, void *buf)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+
+    switch (port) {
+        case PORT_FEEDBACK:
+            symp->ctrl_feedback = buf;
+            break;
+        case PORT_DAMPING:
+            symp->ctrl_damping = buf;
+            break;
+        case PORT_GAIN_INPUT:
+            symp->ctrl_gain_input = buf;
+            break;
+        case PORT_WET_LEFT:
+            symp->ctrl_wet_left = buf;
+            break;
+        case PORT_WET_RIGHT:
+            symp->ctrl_wet_right = buf;
+            break;
+        case PORT_CONTROL:
+            symp->control = buf;
+            break;
+        case PORT_INPUT:
+            symp->audio_input = buf;
+            break;
+        case PORT_OUTPUT1:
+            symp->audio_output1 = buf;
+            break;
+        case PORT_OUTPUT2:
+            symp->audio_output2 = buf;
+            break;
+        case PORT_BANDPASS_LOW:
+            symp->ctrl_bandpass_low = buf;
+            break;
+        case PORT_BANDPASS_HIGH:
+            symp->ctrl_bandpass_high = buf;
+            break;
+        case PORT_BANDPASS_MODE:
+            symp->ctrl_bandpass_mode = buf;
+            break;
+        case PORT_DECAY_TIME:
+            symp->ctrl_decay_time = buf;
+            break;
+        case PORT_EQUAL_DECAY:
+            symp->ctrl_equal_decay = buf;
+            break;
+        case PORT_FREEZE:
+            symp->ctrl_freeze = buf;
+            break;
+        case PORT_TAIL:
+            symp->ctrl_tail = buf;
+            break;
+    }
+}
+
+/* Applies a symp:Tuning message to symp->tunings, returns 1 if it changed
+ * a tuning. */
+static int symp_lv2_tuning_message(struct symp_lv2 *symp, const LV2_Atom_Object *obj)
+{
+    const LV2_Atom *string = NULL, *frequency = NULL;
+    int idx;
+
+    if (obj->body.otype != symp->urids.tuning) return 0;
+
+    lv2_atom_object_get(obj, symp->urids.string, &string,
+            symp->urids.frequency, &frequency, 0);
+    if (string == NULL || string->type != symp->urids.atom_int) return 0;
+    if (frequency == NULL || frequency->type != symp->urids.atom_float) return 0;
+
+    idx = ((const LV2_Atom_Int *)string)->body;
+    if (idx < 0 || idx >= SYMP_CORE_MAX_STRINGS) return 0;
+    if (symp->tunings[idx] == ((const LV2_Atom_Float *)frequency)->body) return 0;
+
+    symp->tunings[idx] = ((const LV2_Atom_Float *)frequency)->body;
+    return 1;
+}
+
+static void symp_lv2_run(LV2_Handle handle, uint32_t sample_count)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    struct symp_core_params *params = &symp->params;
+    struct work work;
+
+    if (symp->control && symp->schedule) {
+        LV2_ATOM_SEQUENCE_FOREACH(symp->control, ev) {
+            if (ev->body.type == symp->urids.atom_object
+                    || ev->body.type == symp->urids.atom_blank)
+                symp->retune |= symp_lv2_tuning_message(symp,
+                        (const LV2_Atom_Object *)&ev->body);
+        }
+    }
+    /* retried in the next block if the worker queue is full */
+    if (symp->retune && symp->schedule) {
+        work.type = WORK_CONFIGURE;
+        memcpy(work.tunings, symp->tunings, sizeof(work.tunings));
+        if (symp->schedule->schedule_work(symp->schedule->handle, sizeof(work), &work)
+                == LV2_WORKER_SUCCESS)
+            symp->retune = 0;
+    }
+
+    params->feedback = *symp->ctrl_feedback;
+    params->damping = *symp->ctrl_damping;
+    params->input_gain = *symp->ctrl_gain_input;
+    params->wet_left = *symp->ctrl_wet_left;
+    params->wet_right = *symp->ctrl_wet_right;
+    params->bandpass_low = *symp->ctrl_bandpass_low;
+    params->bandpass_high = *symp->ctrl_bandpass_high;
+    params->bandpass = lrintf(*symp->ctrl_bandpass_mode)
+        & (SYMP_CORE_BANDPASS_INPUT | SYMP_CORE_BANDPASS_FEEDBACK);
+    /* the tunings are state, so there are no per string ports */
+    params->decay = *symp->ctrl_equal_decay > 0.5f
+        ? SYMP_CORE_DECAY_RT60 : SYMP_CORE_DECAY_GLOBAL;
+    params->rt60 = *symp->ctrl_decay_time;
+    params->freeze = *symp->ctrl_freeze > 0.5f;
+    params->tail = *symp->ctrl_tail > 0.5f;
+    symp_core_set_params(symp->core, params);
+
+    symp_core_process(symp->core, symp->audio_input, symp->audio_output1,
+            symp->audio_output2, sample_count);
+
+    /* the replaced bank comes back at the end of the crossfade */
+    if (symp->schedule && !symp->collecting && symp_core_collect_pending(symp->core)) {
+        work.type = WORK_COLLECT;
+        if (symp->schedule->schedule_work(symp->schedule->handle, sizeof(work), &work)
+                == LV2_WORKER_SUCCESS)
+            symp->collecting = 1;
+    }
+}
+
+/* Worker thread, the only thread that posts to the core: allocates and
+ * posts a comb bank for new tunings, or frees the replaced ones. A post
+ * that fails, because the audio thread has not taken the previous banks
+ * yet, is handed back to run() to retry. */
+static LV2_Worker_Status symp_lv2_work(LV2_Handle handle, LV2_Worker_Respond_Function respond,
+        LV2_Worker_Respond_Handle respond_handle, uint32_t size, const void *data)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    const struct work *request = data;
+    struct symp_core_config config;
+
+    if (size != sizeof(struct work)) return LV2_WORKER_ERR_UNKNOWN;
+
+    if (request->type == WORK_COLLECT) {
+        symp_core_collect(symp->core);
+        return respond(respond_handle, size, request);
+    }
+
+    memcpy(config.tunings, request->tunings, sizeof(config.tunings));
+    if (symp_core_post(symp->core, &config, NULL) < 0)
+        return respond(respond_handle, size, request);
+
+    return LV2_WORKER_SUCCESS;
+}
+
+/* Audio thread: a collect request is done and the next one may be
+ * scheduled, or a configure request failed and is scheduled again */
+static LV2_Worker_Status symp_lv2_work_response(LV2_Handle handle, uint32_t size,
+        const void *data)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    const struct work *response = data;
+
+    if (size != sizeof(struct work)) return LV2_WORKER_ERR_UNKNOWN;
+
+    if (response->type == WORK_COLLECT)
+        symp->collecting = 0;
+    else
+        symp->retune = 1;
+    return LV2_WORKER_SUCCESS;
+}
+
+/* May run concurrently with run(), a tuning message arriving meanwhile is
+ * either saved or not */
+static LV2_State_Status symp_lv2_save(LV2_Handle handle, LV2_State_Store_Function store,
+        LV2_State_Handle state, uint32_t flags, const LV2_Feature *const *features)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    struct {
+        LV2_Atom_Vector_Body head;
+        float tunings[SYMP_CORE_MAX_STRINGS];
+    } vector;
+
+    vector.head.child_size = sizeof(float);
+    vector.head.child_type = symp->urids.atom_float;
+    memcpy(vector.tunings, symp->tunings, sizeof(vector.tunings));
+
+    return store(state, symp->urids.tunings, &vector, sizeof(vector), symp->urids.atom_vector,
+            LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE);
+}
+
+/* Never runs concurrently with run(), but may with the worker. With a
+ * worker, the new tunings are posted by it like those of a tuning
+ * message, scheduled by the next run(). Without one, nothing else
+ * touches the core and the comb bank is replaced here directly. */
+static LV2_State_Status symp_lv2_restore(LV2_Handle handle, LV2_State_Retrieve_Function retrieve,
+        LV2_State_Handle state, uint32_t flags, const LV2_Feature *const *features)
+{
+    struct symp_lv2 *symp = (struct symp_lv2 *)handle;
+    const LV2_Atom_Vector_Body *head;
+    struct symp_core_config config;
+    size_t size;
+    uint32_t type, value_flags;
+    int i;
+
+    head = retrieve(state, symp->urids.tunings, &size, &type, &value_flags);
+    if (head == NULL) return LV2_STATE_ERR_NO_PROPERTY;
+    if (type != symp->urids.atom_vector || size < sizeof(*head)
+            || head->child_type != symp->urids.atom_float
+            || head->child_size != sizeof(float))
+        return LV2_STATE_ERR_BAD_TYPE;
+
+    /* missing strings in older or shorter states are disabled */
+    memset(config.tunings, 0, sizeof(config.tunings));
+    for (i = 0; i < SYMP_CORE_MAX_STRINGS && i < (size - sizeof(*head)) / sizeof(float); i++) {
+        config.tunings[i] = ((const float *)(head + 1))[i];
+    }
+
+    if (symp->schedule) {
+        symp->retune = 1;
+    }
+    else if (symp_core_configure(symp->core, &config) < 0) {
+        return LV2_STATE_ERR_UNKNOWN;
+    }
+    memcpy(symp->tunings, config.tunings, sizeof(symp->tunings));
+
+    return LV2_STATE_SUCCESS;
+}
+
+static const void *symp_lv2_extension_data(const char *uri)
+{
+    static const LV2_Options_Interface options = {
+        symp_lv2_options_get, symp_lv2_options_set
+    };
+    static const LV2_State_Interface state = {
+        symp_lv2_save, symp_lv2_restore
+    };
+    static const LV2_Worker_Interface worker = {
+        symp_lv2_work, symp_lv2_work_response, NULL
+    };
+
+    if (!strcmp(uri, LV2_OPTIONS__interface)) return &options;
+    if (!strcmp(uri, LV2_STATE__interface)) return &state;
+    if (!strcmp(uri, LV2_WORKER__interface)) return &worker;
+    return NULL;
+}
+
+static const LV2_Descriptor symp_lv2_descriptor = {
+    .URI = SYMP_URI,
+    .instantiate = symp_lv2_instantiate,
+    .connect_port = symp_lv2_connect_port,
+    .activate = symp_lv2_activate,
+    .run = symp_lv2_run,
+    .deactivate = NULL,
+    .cleanup = symp_lv2_cleanup,
+    .extension_data = symp_lv2_extension_data
+};
+
+LV2_SYMBOL_EXPORT const LV2_Descriptor *lv2_descriptor(uint32_t idx)
+{
+    switch (idx) {
+        case 0:
+            return &symp_lv2_descriptor;
+        default:
+            return NULL;
+    }
+}
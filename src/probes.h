@@ -0,0 +1,49 @@
+/* USDT static tracepoints for perf and bpftrace
+ *
+ * Compiled in with make USDT=1, which needs <sys/sdt.h> (systemtap-sdt-dev).
+ * Each probe is a single nop in the code until a tracer attaches to it.
+ * Probes use semaphores, which the tracer increments while attached, and
+ * the arguments are only evaluated when SYMP_PROBE_ENABLED() says so.
+ * Otherwise the macros expand to nothing.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_PROBES_H
+#define SYMP_PROBES_H
+
+#ifdef SYMP_USDT
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/* the semaphores sys/sdt.h refers to, one copy per object file that
+ * includes this header, like those dtrace -G would generate */
+#define SYMP_SEMAPHORE(name) \
+    __extension__ static unsigned short sympathetic_##name##_semaphore \
+    __attribute__((unused)) __attribute__((section(".probes")))
+
+SYMP_SEMAPHORE(activate_start);
+SYMP_SEMAPHORE(activate_end);
+SYMP_SEMAPHORE(run_start);
+SYMP_SEMAPHORE(run_end);
+SYMP_SEMAPHORE(run_adding_start);
+SYMP_SEMAPHORE(run_adding_end);
+SYMP_SEMAPHORE(setup_combs_start);
+SYMP_SEMAPHORE(setup_combs_end);
+
+#define SYMP_PROBE_ENABLED(name) \
+    __builtin_expect(*(volatile unsigned short *)&sympathetic_##name##_semaphore, 0)
+
+#define SYMP_PROBE1(name, a) do { \
+    if (SYMP_PROBE_ENABLED(name)) DTRACE_PROBE1(sympathetic, name, a); \
+} while (0)
+#define SYMP_PROBE2(name, a, b) do { \
+    if (SYMP_PROBE_ENABLED(name)) DTRACE_PROBE2(sympathetic, name, a, b); \
+} while (0)
+#else
+#define SYMP_PROBE_ENABLED(name) (0)
+#define SYMP_PROBE1(name, a) do {} while (0)
+#define SYMP_PROBE2(name, a, b) do {} while (0)
+#endif
+
+#endif
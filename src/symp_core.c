@@ -0,0 +1,2210 @@
+/* Sympathetic string resonator core
+ *
+ * Each string is a comb filter tuned to the string's frequency, with a
+ * one-pole low-pass in the feedback path for damping. Strings that have
+ * decayed to silence while there is no input are put to sleep and skipped
+ * until the input returns. The modal engine (symp_modal.c) replaces the
+ * combs with resonators at the first harmonics of each string.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "symp_core.h"
+#include "symp_modal.h"
+#include "probes.h"
+#include "trace.h"
+
+#define FEEDBACK_OFFSET (0.96f)
+#define FEEDBACK_RANGE (0.039f)
+#define DAMPING_RANGE (0.5f)
+
+/* Combs are put to sleep when the input is silent and everything they
+ * hold has decayed below this level (-120 dB), long before their state
+ * reaches the denormal range. */
+#define DORMANT_THRESHOLD (1e-6f)
+
+/* upper bound of the feedback derived from a decay time, the same as that
+ * of the Feedback parameter. The damping does not touch DC, which decays
+ * with the feedback alone. */
+#define RT60_MAX_FEEDBACK (FEEDBACK_OFFSET + FEEDBACK_RANGE)
+
+/* harmonics of each string considered for the gain of the loop kernel */
+#define TAIL_HARMONICS (8)
+
+/* Storage format of the comb delay lines, selected at build time with
+ * SYMP_STORAGE_FP16 or SYMP_STORAGE_INT16 (make STORAGE=fp16|int16).
+ * The smaller formats halve the memory the delay lines take, at the cost
+ * of a conversion on every read and write. The recirculating state and
+ * all arithmetic stay in float. SYMP_FIXED (make FIXED=1) replaces the
+ * float kernel with a fixed point one instead. */
+#if defined(SYMP_FIXED)
+
+#if defined(SYMP_STORAGE_FP16) || defined(SYMP_STORAGE_INT16)
+#error "SYMP_FIXED can not be combined with a comb storage format"
+#endif
+
+/* Samples and the recirculating state are Q4.27 in 32 bits, a range of
+ * +-16 like Q31 with four bits of headroom, the coefficients are Q1.30.
+ * All arithmetic on them is integer and every product is truncated
+ * towards zero, so the combs do not depend on the architecture or the
+ * compiler, and a decaying comb always reaches zero. Float only appears at
+ * the edges: the input sample times the input gain is converted once, the
+ * mixed output is scaled by the wet level once per channel. These are
+ * single float multiplies, bit-identical as long as they are not fused or
+ * reordered, hence -ffp-contract=off in the Makefile. */
+#define STORAGE_SUFFIX ", q31"
+#define STORAGE_ID (3)
+#define FIXED_ONE (1 << 27)
+#define COEF_ONE (1 << 30)
+#define COEF(x) ((int32_t)((x) * (double)COEF_ONE + 0.5))
+typedef int32_t comb_sample;
+typedef int32_t comb_state;
+typedef int32_t comb_coef;
+
+static inline int32_t fixed_saturate(int64_t v)
+{
+    if (v > INT32_MAX) return INT32_MAX;
+    if (v < -INT32_MAX) return -INT32_MAX;
+    return v;
+}
+
+/* Scales a product with a Q1.30 coefficient back, truncating towards zero */
+static inline int64_t coef_shift(int64_t p)
+{
+    return (p + ((p >> 63) & (COEF_ONE - 1))) >> 30;
+}
+
+static inline comb_sample fixed_from_float(float v)
+{
+    v = fminf(fmaxf(v, -16.0f), 16.0f);
+    return fixed_saturate((int64_t)(v * FIXED_ONE));
+}
+
+static inline comb_coef coef_from_float(float v)
+{
+    v = fminf(fmaxf(v, 0.0f), 1.0f);
+    return (int32_t)(v * COEF_ONE);
+}
+
+static inline float coef_load(comb_coef c)
+{
+    return c * (1.0f / COEF_ONE);
+}
+
+static inline float comb_load(comb_sample s)
+{
+    return s * (1.0f / FIXED_ONE);
+}
+
+static inline float comb_state_level(comb_state s)
+{
+    return fabsf(comb_load(s));
+}
+
+static inline void symp_core_damping_coefs(float damping, comb_coef *damp1, comb_coef *damp2)
+{
+    *damp1 = coef_shift((int64_t)coef_from_float(damping) * COEF(DAMPING_RANGE));
+    *damp2 = COEF_ONE - *damp1;
+}
+
+static inline comb_coef symp_core_feedback_coef(float feedback)
+{
+    return COEF(FEEDBACK_OFFSET)
+        + coef_shift((int64_t)coef_from_float(feedback) * COEF(FEEDBACK_RANGE));
+}
+
+/* The sum of comb outputs in the loop kernel, and its scale to 1.0 */
+typedef int64_t comb_acc;
+#define ACC_SCALE (1.0f / FIXED_ONE)
+
+static inline comb_acc comb_acc_load(comb_sample s)
+{
+    return s;
+}
+
+static inline comb_sample comb_scale(comb_sample s, comb_coef g)
+{
+    return coef_shift((int64_t)s * g);
+}
+
+static inline comb_state comb_state_from(comb_sample s)
+{
+    return s;
+}
+
+#elif defined(SYMP_STORAGE_FP16)
+
+/* IEEE 754 half precision, converted in software with rounding to nearest
+ * even. The relative rounding error of at most 2^-11 is smaller than the
+ * loss of one pass through the comb at maximum feedback, so a decaying comb
+ * keeps decaying. Values below the normal half range (2^-14, -84 dB) are
+ * stored as zero, so that it ends in silence instead of a limit cycle among
+ * the subnormals, and values beyond the half range saturate at +-65504. */
+#define STORAGE_SUFFIX ", fp16"
+#define STORAGE_ID (1)
+typedef uint16_t comb_sample;
+
+static inline comb_sample comb_save(float v)
+{
+    union { float f; uint32_t u; } x = { v };
+    uint32_t sign = (x.u >> 16) & 0x8000;
+    uint32_t a = x.u & 0x7fffffff;
+
+    if (a < 0x38800000)
+        return sign;
+    if (a >= 0x477ff000)
+        return sign | 0x7bff;
+    a -= (127 - 15) << 23;
+    return sign | ((a + 0xfff + ((a >> 13) & 1)) >> 13);
+}
+
+static inline float comb_load(comb_sample h)
+{
+    union { uint32_t u; float f; } x;
+
+    x.u = ((uint32_t)(h & 0x8000) << 16) | ((uint32_t)(h & 0x7fff) << 13);
+    if (h & 0x7fff)
+        x.u += (127 - 15) << 23;
+    return x.f;
+}
+
+#elif defined(SYMP_STORAGE_INT16)
+
+/* Fixed point with STORAGE_SCALE steps per unit, giving a range of +-8,
+ * values beyond that saturate. A single comb reaches about +-5 at the
+ * default input gain with a sustained tone on its frequency. Values are
+ * truncated towards zero: with rounding, a comb at high feedback would
+ * settle into a limit cycle far above the dormancy threshold. The price is
+ * a faster decay of quiet tails. */
+#define STORAGE_SUFFIX ", int16"
+#define STORAGE_ID (2)
+#define STORAGE_SCALE (4096.0f)
+typedef int16_t comb_sample;
+
+static inline comb_sample comb_save(float v)
+{
+    v *= STORAGE_SCALE;
+    if (v > INT16_MAX) v = INT16_MAX;
+    else if (v < -INT16_MAX) v = -INT16_MAX;
+    return (comb_sample)v;
+}
+
+static inline float comb_load(comb_sample s)
+{
+    return s * (1.0f / STORAGE_SCALE);
+}
+
+#else
+
+#define STORAGE_SUFFIX ""
+#define STORAGE_ID (0)
+typedef float comb_sample;
+
+static inline comb_sample comb_save(float v)
+{
+    return v;
+}
+
+static inline float comb_load(comb_sample s)
+{
+    return s;
+}
+
+#endif
+
+#if defined(SYMP_FIXED) && defined(SYMP_SCAN)
+#error "SYMP_SCAN needs the float comb kernel"
+#endif
+
+#ifdef SYMP_SCAN
+#define KERNEL_NAME "scan"
+#else
+#define KERNEL_NAME "scalar"
+#endif
+
+#ifndef SYMP_FIXED
+typedef float comb_state;
+typedef float comb_coef;
+
+static inline comb_coef coef_from_float(float v)
+{
+    return v;
+}
+
+static inline float coef_load(comb_coef c)
+{
+    return c;
+}
+
+static inline float comb_state_level(comb_state s)
+{
+    return fabsf(s);
+}
+
+static inline void symp_core_damping_coefs(float damping, comb_coef *damp1, comb_coef *damp2)
+{
+    *damp1 = damping * DAMPING_RANGE;
+    *damp2 = 1 - *damp1;
+}
+
+static inline comb_coef symp_core_feedback_coef(float feedback)
+{
+    return FEEDBACK_OFFSET + (feedback * FEEDBACK_RANGE);
+}
+
+typedef float comb_acc;
+#define ACC_SCALE (1.0f)
+
+static inline comb_acc comb_acc_load(comb_sample s)
+{
+    return comb_load(s);
+}
+
+static inline comb_sample comb_scale(comb_sample s, comb_coef g)
+{
+    return comb_save(comb_load(s) * g);
+}
+
+static inline comb_state comb_state_from(comb_sample s)
+{
+    return comb_load(s);
+}
+#endif
+
+/* Coefficients of the band-pass, see symp_core_params: a one-pole low-pass
+ * at the lower cutoff whose output is subtracted, then a one-pole low-pass
+ * at the upper cutoff. A missing cutoff gives an exact pass-through. */
+struct bandpass {
+    float low1;
+    float low2;
+    float high1;
+    float high2;
+};
+
+struct bandpass_state {
+    float low;
+    float high;
+};
+
+struct comb {
+  comb_state store;
+  struct bandpass_state bp;
+  comb_coef damp1;
+  comb_coef damp2;
+  comb_coef feedback;
+  comb_coef tail_gain;
+  comb_sample *buffer;
+  int size;
+  int idx;
+  int string;
+  float peak;
+  float sumsq;
+};
+
+/* Taps per phase of the polyphase decimation and interpolation filters,
+ * their cutoff as a fraction of the decimated Nyquist frequency, and the
+ * number of samples filtered at a time */
+#define DECIM_TAPS (8)
+#define DECIM_MAX (4)
+#define DECIM_CUTOFF (0.8f)
+#define DECIM_CHUNK (128)
+
+/* Capacity of the command and return queues, a power of two */
+#define QUEUE_SIZE (16)
+
+struct comb_bank {
+    struct comb *combs[SYMP_CORE_MAX_STRINGS];
+    int num_combs;
+};
+
+/* A posted change: a new comb bank and/or new parameters. On the return
+ * queue, bank holds the combs that were replaced. */
+struct message {
+    struct comb_bank *bank;
+    int has_params;
+    struct symp_core_params params;
+};
+
+/* Single producer, single consumer ring. head is only written by the
+ * producer, tail only by the consumer. */
+struct queue {
+    struct message msgs[QUEUE_SIZE];
+    unsigned int head;
+    unsigned int tail;
+};
+
+struct symp_core
+{
+    struct comb *combs[SYMP_CORE_MAX_STRINGS];
+    int num_combs;
+
+    /* combs that are currently processed, the others are dormant */
+    struct comb *active[SYMP_CORE_MAX_STRINGS];
+    int num_active;
+
+    struct symp_core_params params;
+
+    float damping;
+    comb_coef damp1;
+    comb_coef damp2;
+
+    float feedback;
+    comb_coef scaled_feedback;
+
+    /* the band-pass at the rate of the strings, for the cutoffs in
+     * bandpass_low and bandpass_high, and its state on the input */
+    float bandpass_low;
+    float bandpass_high;
+    int bandpass;
+    struct bandpass bp;
+    struct bandpass_state in_bp;
+
+    /* params.decay, the coefficients of each string are in its comb */
+    int decay;
+
+    int metering;
+    unsigned long last_sample_count;
+
+    /* posted by symp_core_post(), drained by the audio thread */
+    struct queue commands;
+    /* replaced comb banks, freed by symp_core_collect() */
+    struct queue returns;
+    /* banks posted and not yet collected, only used by the producer */
+    int pending_banks;
+
+    /* the replaced bank of a tuning change, faded out without input over
+     * fade_len samples, its combs keep the coefficients they had before
+     * the change */
+    unsigned long crossfade;
+    struct comb_bank *fade_bank;
+    struct comb *fade_active[SYMP_CORE_MAX_STRINGS];
+    int num_fade;
+    unsigned long fade_len;
+    unsigned long fade_pos;
+    float fade_wet_left;
+    float fade_wet_right;
+
+    /* the combs run at sample_rate / decimation, see
+     * symp_core_set_decimation(). decim_phase counts the input samples
+     * since the last decimated one, the histories hold the last inputs and
+     * comb outputs, oldest first. */
+    int decimation;
+    int decim_phase;
+    float decim_taps[DECIM_TAPS * DECIM_MAX];
+    float interp_taps[DECIM_MAX][DECIM_TAPS];
+    float decim_hist[DECIM_TAPS * DECIM_MAX];
+    float interp_hist[DECIM_TAPS];
+
+    /* with SYMP_CORE_ENGINE_MODAL, the strings live in modal and the comb
+     * bank stays empty */
+    int engine;
+    struct symp_modal modal;
+
+    unsigned long sample_rate;
+
+#ifdef SYMP_TRACE
+    struct symp_trace trace;
+#endif
+};
+
+/* The comb strings run at the decimated rate, the modal ones at the full
+ * rate */
+static void symp_core_update_bandpass(struct symp_core *core)
+{
+    float rate = core->sample_rate;
+
+    if (core->engine == SYMP_CORE_ENGINE_COMB)
+        rate /= core->decimation;
+
+    core->bp.low2 = core->bandpass_low > 0 ? expf(-2 * M_PI * core->bandpass_low / rate) : 1.0f;
+    core->bp.low1 = 1 - core->bp.low2;
+    core->bp.high2 = core->bandpass_high > 0 ? expf(-2 * M_PI * core->bandpass_high / rate) : 0.0f;
+    core->bp.high1 = 1 - core->bp.high2;
+}
+
+int symp_core_api_version(void)
+{
+    return SYMP_CORE_API_VERSION;
+}
+
+struct symp_core *symp_core_create(unsigned long sample_rate)
+{
+    struct symp_core *core;
+
+    core = malloc(sizeof(struct symp_core));
+    if (core == NULL) return NULL;
+    memset(core, 0, sizeof(struct symp_core));
+
+    core->sample_rate = sample_rate;
+    core->decimation = 1;
+    symp_core_damping_coefs(0, &core->damp1, &core->damp2);
+    symp_core_update_bandpass(core);
+    core->crossfade = sample_rate / 50;
+
+    return core;
+}
+
+static void symp_core_free_combs(struct comb **combs, int num_combs)
+{
+    int i;
+
+    for (i = 0; i < num_combs; i++) {
+        free(combs[i]->buffer);
+        free(combs[i]);
+        combs[i] = NULL;
+    }
+}
+
+/* Allocates silent combs for the tunings in config, returns the number of
+ * combs or -1 if out of memory */
+static int symp_core_alloc_combs(unsigned long sample_rate,
+        const struct symp_core_config *config, struct comb **combs)
+{
+    int i;
+    int size;
+    int num_combs = 0;
+    struct comb *comb;
+
+    for (i = 0; config && i < SYMP_CORE_MAX_STRINGS; i++) {
+        if (config->tunings[i] <= 0) continue;
+
+        size = sample_rate / config->tunings[i];
+        if (size < 1) size = 1;
+        comb = malloc(sizeof(struct comb));
+        if (comb == NULL) {
+            symp_core_free_combs(combs, num_combs);
+            return -1;
+        }
+        combs[num_combs++] = comb;
+        memset(comb, 0, sizeof(struct comb));
+
+        comb->buffer = malloc(size * sizeof(comb_sample));
+        if (comb->buffer == NULL) {
+            symp_core_free_combs(combs, num_combs);
+            return -1;
+        }
+        memset(comb->buffer, 0, size * sizeof(comb_sample));
+        comb->size = size;
+        comb->string = i;
+    }
+
+    return num_combs;
+}
+
+static void symp_core_cleanup_combs(struct symp_core *core)
+{
+    symp_core_free_combs(core->combs, core->num_combs);
+    core->num_combs = 0;
+    core->num_active = 0;
+}
+
+/* Hands a replaced bank back to the posting thread */
+static void symp_core_return_bank(struct symp_core *core, struct comb_bank *bank)
+{
+    struct queue *ret = &core->returns;
+
+    ret->msgs[ret->head & (QUEUE_SIZE - 1)].bank = bank;
+    __atomic_store_n(&ret->head, ret->head + 1, __ATOMIC_RELEASE);
+}
+
+static void symp_core_end_fade(struct symp_core *core)
+{
+    if (core->fade_bank == NULL) return;
+
+    symp_core_return_bank(core, core->fade_bank);
+    core->fade_bank = NULL;
+    core->num_fade = 0;
+}
+
+/* Frees the comb banks that the audio thread has handed back */
+void symp_core_collect(struct symp_core *core)
+{
+    struct queue *ret = &core->returns;
+    unsigned int head = __atomic_load_n(&ret->head, __ATOMIC_ACQUIRE);
+    unsigned int tail = ret->tail;
+    struct comb_bank *bank;
+
+    while (tail != head) {
+        bank = ret->msgs[tail & (QUEUE_SIZE - 1)].bank;
+        symp_core_free_combs(bank->combs, bank->num_combs);
+        free(bank);
+        core->pending_banks--;
+        tail++;
+    }
+    __atomic_store_n(&ret->tail, tail, __ATOMIC_RELEASE);
+}
+
+int symp_core_collect_pending(const struct symp_core *core)
+{
+    return __atomic_load_n(&core->returns.head, __ATOMIC_ACQUIRE)
+        != __atomic_load_n(&core->returns.tail, __ATOMIC_RELAXED);
+}
+
+void symp_core_destroy(struct symp_core *core)
+{
+    struct queue *cmds;
+    unsigned int tail;
+    struct comb_bank *bank;
+
+    if (core == NULL) return;
+
+    /* banks that were posted but never processed */
+    cmds = &core->commands;
+    for (tail = cmds->tail; tail != cmds->head; tail++) {
+        bank = cmds->msgs[tail & (QUEUE_SIZE - 1)].bank;
+        if (bank == NULL) continue;
+        symp_core_free_combs(bank->combs, bank->num_combs);
+        free(bank);
+    }
+    symp_core_end_fade(core);
+    symp_core_collect(core);
+
+    symp_core_cleanup_combs(core);
+    free(core);
+}
+
+static void symp_core_string_damping(const struct symp_core *core, float damping,
+        comb_coef *damp1, comb_coef *damp2)
+{
+    symp_core_damping_coefs(damping, damp1, damp2);
+#ifndef SYMP_FIXED
+    /* the same time constant at the decimated rate */
+    if (core->decimation > 1) {
+        *damp1 = powf(*damp1, core->decimation);
+        *damp2 = 1 - *damp1;
+    }
+#endif
+}
+
+static void symp_core_update_damping(struct symp_core *core)
+{
+    symp_core_string_damping(core, core->damping, &core->damp1, &core->damp2);
+}
+
+/* The feedback that lets the fundamental of a string of period samples at
+ * rate decay by 60 dB in rt60 seconds: the loss per period, divided by the
+ * gain of the damping low-pass at the fundamental */
+static float symp_core_rt60_feedback(float rt60, float period, float rate, float damp1)
+{
+    float w = 2 * M_PI / period;
+    float loss = powf(10.0f, -3.0f * period / (rate * rt60));
+
+    return fminf(loss * sqrtf(1 - 2 * damp1 * cosf(w) + damp1 * damp1) / (1 - damp1),
+            RT60_MAX_FEEDBACK);
+}
+
+#ifndef SYMP_FIXED
+/* The gain of one pass through a comb at a harmonic with cos(w) = c: the
+ * feedback times the magnitudes of the damping and, in the feedback path,
+ * of the band-pass */
+static float symp_core_pass_gain(const struct symp_core *core, const struct comb *comb, float c)
+{
+    float d = coef_load(comb->damp1);
+    float g = coef_load(comb->feedback) * (1 - d) / sqrtf(1 - 2 * d * c + d * d);
+    float low = core->bp.low2;
+    float high = core->bp.high2;
+
+    if (core->bandpass & SYMP_CORE_BANDPASS_FEEDBACK) {
+        if (low < 1)
+            g *= low * sqrtf(2 - 2 * c) / sqrtf(1 - 2 * low * c + low * low);
+        if (high > 0)
+            g *= (1 - high) / sqrtf(1 - 2 * high * c + high * high);
+    }
+    return g;
+}
+
+/* The gain per pass of the loop kernel: that of the slowest decaying of
+ * the first TAIL_HARMONICS harmonics, which carries the tail. Without the
+ * high-pass in the feedback path, the fundamental. */
+static comb_coef symp_core_tail_gain(const struct symp_core *core, const struct comb *comb)
+{
+    float g = 0.0f;
+    int k;
+
+    for (k = 1; k <= TAIL_HARMONICS && 2 * k < comb->size; k++) {
+        g = fmaxf(g, symp_core_pass_gain(core, comb, cosf(2 * M_PI * k / comb->size)));
+    }
+    return coef_from_float(g);
+}
+#endif
+
+/* Sets the coefficients of every comb and modal string from the global or
+ * per-string parameters, see symp_core_params.decay. The combs of a
+ * crossfading bank keep theirs. Real-time safe, called whenever the
+ * parameters or the strings change. */
+static void symp_core_update_decay(struct symp_core *core)
+{
+    const struct symp_core_params *params = &core->params;
+    float rate = (float)core->sample_rate / core->decimation;
+    float feedback[SYMP_CORE_MAX_STRINGS], damping[SYMP_CORE_MAX_STRINGS];
+#ifdef SYMP_FIXED
+    /* the RT60 feedback comes from libm, which is not bit-exact everywhere */
+    int rt60 = 0;
+#else
+    int rt60 = core->decay == SYMP_CORE_DECAY_RT60 && params->rt60 > 0;
+#endif
+    int fb = core->bandpass & SYMP_CORE_BANDPASS_FEEDBACK;
+    struct modal_string *str;
+    struct comb *comb;
+    comb_coef damp1, damp2;
+    int i, n;
+
+    for (i = 0; i < core->num_combs; i++) {
+        comb = core->combs[i];
+        n = comb->string;
+
+        comb->damp1 = core->damp1;
+        comb->damp2 = core->damp2;
+        comb->feedback = core->scaled_feedback;
+        if (core->decay == SYMP_CORE_DECAY_STRINGS) {
+            symp_core_string_damping(core, params->string_damping[n], &comb->damp1, &comb->damp2);
+            comb->feedback = symp_core_feedback_coef(params->string_feedback[n]);
+        }
+        else if (rt60) {
+            comb->feedback = coef_from_float(symp_core_rt60_feedback(params->rt60, comb->size,
+                        rate, coef_load(comb->damp1)));
+        }
+#ifndef SYMP_FIXED
+        comb->tail_gain = symp_core_tail_gain(core, comb);
+#endif
+    }
+
+    if (core->engine != SYMP_CORE_ENGINE_MODAL) return;
+
+    /* the modal strings follow the comb coefficients at the full rate,
+     * including the band-pass in the feedback path. The damping is the
+     * damp1 of the combs before symp_core_string_damping() moves it to the
+     * decimated rate, the modal engine always runs at the full rate. */
+    for (i = 0; i < core->modal.num_strings; i++) {
+        str = &core->modal.strings[i];
+        n = str->string;
+
+        symp_core_damping_coefs(core->damping, &damp1, &damp2);
+        feedback[n] = coef_load(core->scaled_feedback);
+        if (core->decay == SYMP_CORE_DECAY_STRINGS) {
+            symp_core_damping_coefs(params->string_damping[n], &damp1, &damp2);
+            feedback[n] = coef_load(symp_core_feedback_coef(params->string_feedback[n]));
+        }
+        damping[n] = coef_load(damp1);
+        if (rt60) {
+            feedback[n] = symp_core_rt60_feedback(params->rt60, core->sample_rate / str->freq,
+                    core->sample_rate, damping[n]);
+        }
+    }
+    symp_modal_set_coefs(&core->modal, feedback, damping, fb ? core->bp.low2 : 1.0f,
+            fb ? core->bp.high2 : 0.0f);
+}
+
+int symp_core_configure(struct symp_core *core, const struct symp_core_config *config)
+{
+    int ret;
+
+    SYMP_PROBE1(setup_combs_start, core->sample_rate);
+
+    symp_core_end_fade(core);
+    symp_core_collect(core);
+    symp_core_cleanup_combs(core);
+    symp_modal_configure(&core->modal, core->sample_rate, NULL);
+
+    if (core->engine == SYMP_CORE_ENGINE_MODAL) {
+        symp_modal_configure(&core->modal, core->sample_rate, config);
+        symp_core_update_decay(core);
+        SYMP_PROBE2(setup_combs_end, 0, core->modal.num_strings);
+        return 0;
+    }
+
+    ret = symp_core_alloc_combs(core->sample_rate / core->decimation, config, core->combs);
+    if (ret > 0)
+        core->num_combs = ret;
+    if (ret > 0 || config == NULL)
+        ret = 0;
+
+    memcpy(core->active, core->combs, sizeof(core->active));
+    core->num_active = core->num_combs;
+    symp_core_update_decay(core);
+
+    SYMP_PROBE2(setup_combs_end, ret, core->num_combs);
+
+    return ret;
+}
+
+int symp_core_post(struct symp_core *core, const struct symp_core_config *config,
+        const struct symp_core_params *params)
+{
+    struct queue *cmds = &core->commands;
+    unsigned int head = cmds->head;
+    unsigned int tail = __atomic_load_n(&cmds->tail, __ATOMIC_ACQUIRE);
+    struct message *msg;
+    struct comb_bank *bank = NULL;
+    int num_combs;
+
+    symp_core_collect(core);
+
+    /* every bank in flight comes back through the return queue, which
+     * therefore never overflows */
+    if (head - tail >= QUEUE_SIZE || (config && core->pending_banks >= QUEUE_SIZE))
+        return -1;
+    if (config && core->engine == SYMP_CORE_ENGINE_MODAL)
+        return -1;
+
+    if (config) {
+        bank = malloc(sizeof(struct comb_bank));
+        if (bank == NULL) return -1;
+        num_combs = symp_core_alloc_combs(core->sample_rate / core->decimation, config,
+                bank->combs);
+        if (num_combs < 0) {
+            free(bank);
+            return -1;
+        }
+        bank->num_combs = num_combs;
+        core->pending_banks++;
+    }
+
+    msg = &cmds->msgs[head & (QUEUE_SIZE - 1)];
+    msg->bank = bank;
+    msg->has_params = params != NULL;
+    if (params)
+        msg->params = *params;
+    __atomic_store_n(&cmds->head, head + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void symp_core_reset(struct symp_core *core)
+{
+    struct comb *comb;
+    int i;
+
+    for (i = 0; i < core->num_combs; i++) {
+        comb = core->combs[i];
+        memset(comb->buffer, 0, comb->size * sizeof(comb_sample));
+        comb->store = 0;
+        comb->bp.low = 0;
+        comb->bp.high = 0;
+        comb->idx = 0;
+        comb->peak = 0;
+        comb->sumsq = 0;
+    }
+    memset(&core->in_bp, 0, sizeof(core->in_bp));
+    memcpy(core->active, core->combs, sizeof(core->active));
+    core->num_active = core->num_combs;
+    symp_core_end_fade(core);
+
+    memset(core->decim_hist, 0, sizeof(core->decim_hist));
+    memset(core->interp_hist, 0, sizeof(core->interp_hist));
+    symp_modal_reset(&core->modal);
+}
+
+void symp_core_set_crossfade(struct symp_core *core, unsigned long sample_count)
+{
+    __atomic_store_n(&core->crossfade, sample_count, __ATOMIC_RELAXED);
+}
+
+/* Designs the filters as a Blackman windowed sinc, normalised to unity
+ * gain at DC. The interpolation filter is the same, split into one set of
+ * taps per phase, in reverse order to run over the oldest comb output
+ * first, and scaled by the factor for the zero stuffing. */
+int symp_core_set_decimation(struct symp_core *core, int factor)
+{
+    int len = DECIM_TAPS * factor;
+    float fc = DECIM_CUTOFF / (2 * factor);
+    float x, w, sum = 0;
+    int n;
+
+#ifdef SYMP_FIXED
+    if (factor != 1) return -1;
+#endif
+    if ((factor != 1 && factor != 2 && factor != 4)
+            || core->num_combs > 0 || core->pending_banks > 0)
+        return -1;
+
+    for (n = 0; n < len; n++) {
+        x = n - (len - 1) / 2.0f;
+        w = 0.42f - 0.5f * cosf(2 * M_PI * (n + 1) / (len + 1))
+            + 0.08f * cosf(4 * M_PI * (n + 1) / (len + 1));
+        core->decim_taps[n] = w * (x == 0 ? 2 * fc : sinf(2 * M_PI * fc * x) / (M_PI * x));
+        sum += core->decim_taps[n];
+    }
+    for (n = 0; n < len; n++) {
+        core->decim_taps[n] /= sum;
+        core->interp_taps[n % factor][DECIM_TAPS - 1 - n / factor] = core->decim_taps[n] * factor;
+    }
+
+    core->decimation = factor;
+    core->decim_phase = 0;
+    memset(core->decim_hist, 0, sizeof(core->decim_hist));
+    memset(core->interp_hist, 0, sizeof(core->interp_hist));
+    symp_core_update_damping(core);
+    symp_core_update_bandpass(core);
+
+    return 0;
+}
+
+int symp_core_set_engine(struct symp_core *core, int engine)
+{
+#ifdef SYMP_FIXED
+    if (engine != SYMP_CORE_ENGINE_COMB) return -1;
+#endif
+    if ((engine != SYMP_CORE_ENGINE_COMB && engine != SYMP_CORE_ENGINE_MODAL)
+            || core->num_combs > 0 || core->modal.num_strings > 0
+            || core->pending_banks > 0)
+        return -1;
+
+    core->engine = engine;
+    symp_core_update_bandpass(core);
+    return 0;
+}
+
+void symp_core_set_params(struct symp_core *core, const struct symp_core_params *params)
+{
+    int changed = 0, i;
+
+    /* only the values of the selected decay mode are compared */
+    if (params->decay != core->decay
+            || (params->decay == SYMP_CORE_DECAY_RT60
+                && params->rt60 != core->params.rt60)
+            || (params->decay == SYMP_CORE_DECAY_STRINGS
+                && (memcmp(params->string_feedback, core->params.string_feedback,
+                        sizeof(params->string_feedback))
+                    || memcmp(params->string_damping, core->params.string_damping,
+                        sizeof(params->string_damping))))) {
+        core->decay = params->decay;
+        changed = 1;
+    }
+
+    core->params = *params;
+
+    if (core->params.wet_left < 0) core->params.wet_left = 0;
+    else if (core->params.wet_left > 1.0) core->params.wet_left = 1.0;
+
+    if (core->params.wet_right < 0) core->params.wet_right = 0;
+    else if (core->params.wet_right > 1.0) core->params.wet_right = 1.0;
+
+    if (params->damping != core->damping) {
+        core->damping = params->damping;
+        symp_core_update_damping(core);
+        changed = 1;
+    }
+
+    if (params->feedback != core->feedback) {
+        core->feedback = params->feedback;
+        core->scaled_feedback = symp_core_feedback_coef(core->feedback);
+        changed = 1;
+    }
+
+    if (params->bandpass_low != core->bandpass_low
+            || params->bandpass_high != core->bandpass_high) {
+        core->bandpass_low = params->bandpass_low;
+        core->bandpass_high = params->bandpass_high;
+        symp_core_update_bandpass(core);
+        changed = 1;
+
+        /* without the high-pass, its low-pass would hold its last value */
+        if (core->bandpass_low <= 0) {
+            core->in_bp.low = 0;
+            for (i = 0; i < core->num_combs; i++) {
+                core->combs[i]->bp.low = 0;
+            }
+        }
+    }
+
+    /* the state of a filter that is not in use stays at 0 */
+    if (params->bandpass != core->bandpass) {
+        if ((params->bandpass ^ core->bandpass) & SYMP_CORE_BANDPASS_INPUT)
+            memset(&core->in_bp, 0, sizeof(core->in_bp));
+        if ((params->bandpass ^ core->bandpass) & SYMP_CORE_BANDPASS_FEEDBACK) {
+            for (i = 0; i < core->num_combs; i++) {
+                core->combs[i]->bp.low = 0;
+                core->combs[i]->bp.high = 0;
+            }
+        }
+        core->bandpass = params->bandpass;
+        changed = 1;
+    }
+
+    if (changed)
+        symp_core_update_decay(core);
+}
+
+void symp_core_set_metering(struct symp_core *core, int enabled)
+{
+    core->metering = enabled;
+}
+
+int symp_core_num_active(const struct symp_core *core)
+{
+    if (core->engine == SYMP_CORE_ENGINE_MODAL)
+        return core->modal.num_active;
+    return core->num_active;
+}
+
+void symp_core_get_stats(const struct symp_core *core, struct symp_core_stats *stats)
+{
+    const struct modal_string *str;
+    struct comb *comb;
+    int i;
+
+    memset(stats, 0, sizeof(struct symp_core_stats));
+    if (core->engine == SYMP_CORE_ENGINE_MODAL) {
+        stats->num_strings = core->modal.num_strings;
+        stats->num_active = core->modal.num_active;
+    }
+    else {
+        stats->num_strings = core->num_combs;
+        stats->num_active = core->num_active;
+    }
+
+    if (!core->metering || core->last_sample_count == 0) return;
+
+    for (i = 0; i < core->modal.num_strings; i++) {
+        str = &core->modal.strings[i];
+        stats->peak[str->string] = str->peak;
+        stats->rms[str->string] = sqrtf(str->sumsq / core->last_sample_count);
+    }
+    for (i = 0; i < core->num_combs; i++) {
+        comb = core->combs[i];
+        stats->peak[comb->string] = comb->peak;
+        stats->rms[comb->string] = sqrtf(comb->sumsq / core->last_sample_count);
+    }
+}
+
+/* Snapshot layout: the header, one snapshot_comb per comb, then the comb
+ * buffers one after the other, in the storage format of the build */
+#define SNAPSHOT_MAGIC (0x504d5953)
+#define SNAPSHOT_VERSION (6)
+
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t storage;
+    uint32_t sample_rate;
+    int32_t num_combs;
+    struct symp_core_params params;
+    float damping;
+    comb_coef damp1;
+    comb_coef damp2;
+    float feedback;
+    comb_coef scaled_feedback;
+    struct bandpass_state in_bp;
+    int32_t decimation;
+    int32_t decim_phase;
+    float decim_hist[DECIM_TAPS * DECIM_MAX];
+    float interp_hist[DECIM_TAPS];
+};
+
+struct snapshot_comb {
+    int32_t string;
+    int32_t size;
+    int32_t idx;
+    comb_state store;
+    struct bandpass_state bp;
+};
+
+size_t symp_core_snapshot_size(const struct symp_core *core)
+{
+    size_t size = sizeof(struct snapshot_header);
+    int i;
+
+    for (i = 0; i < core->num_combs; i++) {
+        size += sizeof(struct snapshot_comb) + core->combs[i]->size * sizeof(comb_sample);
+    }
+    return size;
+}
+
+long symp_core_snapshot(const struct symp_core *core, void *buf, size_t size)
+{
+    struct snapshot_header *header = buf;
+    struct snapshot_comb *sc = (struct snapshot_comb *)(header + 1);
+    comb_sample *data = (comb_sample *)(sc + core->num_combs);
+    size_t needed = symp_core_snapshot_size(core);
+    struct comb *comb;
+    int i;
+
+    if (size < needed || core->engine != SYMP_CORE_ENGINE_COMB) return -1;
+
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->size = needed;
+    header->storage = STORAGE_ID;
+    header->sample_rate = core->sample_rate;
+    header->num_combs = core->num_combs;
+    header->params = core->params;
+    header->damping = core->damping;
+    header->damp1 = core->damp1;
+    header->damp2 = core->damp2;
+    header->feedback = core->feedback;
+    header->scaled_feedback = core->scaled_feedback;
+    header->in_bp = core->in_bp;
+    header->decimation = core->decimation;
+    header->decim_phase = core->decim_phase;
+    memcpy(header->decim_hist, core->decim_hist, sizeof(header->decim_hist));
+    memcpy(header->interp_hist, core->interp_hist, sizeof(header->interp_hist));
+
+    for (i = 0; i < core->num_combs; i++) {
+        comb = core->combs[i];
+        sc[i].string = comb->string;
+        sc[i].size = comb->size;
+        sc[i].idx = comb->idx;
+        sc[i].store = comb->store;
+        sc[i].bp = comb->bp;
+        memcpy(data, comb->buffer, comb->size * sizeof(comb_sample));
+        data += comb->size;
+    }
+
+    return needed;
+}
+
+int symp_core_restore(struct symp_core *core, const void *buf, size_t size)
+{
+    const struct snapshot_header *header = buf;
+    const struct snapshot_comb *sc = (const struct snapshot_comb *)(header + 1);
+    const comb_sample *data = (const comb_sample *)(sc + core->num_combs);
+    struct comb *comb;
+    int i;
+
+    if (core->engine != SYMP_CORE_ENGINE_COMB
+            || size < sizeof(*header) || header->magic != SNAPSHOT_MAGIC
+            || header->version != SNAPSHOT_VERSION || header->size > size
+            || header->storage != STORAGE_ID
+            || header->size != symp_core_snapshot_size(core)
+            || header->sample_rate != core->sample_rate
+            || header->num_combs != core->num_combs
+            || header->decimation != core->decimation
+            || header->decim_phase < 0 || header->decim_phase >= core->decimation)
+        return -1;
+
+    for (i = 0; i < core->num_combs; i++) {
+        comb = core->combs[i];
+        if (sc[i].string != comb->string || sc[i].size != comb->size
+                || sc[i].idx < 0 || sc[i].idx >= comb->size)
+            return -1;
+    }
+
+    core->params = header->params;
+    core->damping = header->damping;
+    core->damp1 = header->damp1;
+    core->damp2 = header->damp2;
+    core->feedback = header->feedback;
+    core->scaled_feedback = header->scaled_feedback;
+    core->bandpass_low = header->params.bandpass_low;
+    core->bandpass_high = header->params.bandpass_high;
+    core->bandpass = header->params.bandpass;
+    core->in_bp = header->in_bp;
+    core->decim_phase = header->decim_phase;
+    memcpy(core->decim_hist, header->decim_hist, sizeof(core->decim_hist));
+    memcpy(core->interp_hist, header->interp_hist, sizeof(core->interp_hist));
+    core->decay = header->params.decay;
+    symp_core_update_bandpass(core);
+
+    for (i = 0; i < core->num_combs; i++) {
+        comb = core->combs[i];
+        comb->idx = sc[i].idx;
+        comb->store = sc[i].store;
+        comb->bp = sc[i].bp;
+        memcpy(comb->buffer, data, comb->size * sizeof(comb_sample));
+        data += comb->size;
+    }
+
+    /* dormant combs are found again by the next silent block */
+    memcpy(core->active, core->combs, sizeof(core->active));
+    core->num_active = core->num_combs;
+    symp_core_end_fade(core);
+    symp_core_update_decay(core);
+
+    return 0;
+}
+
+#ifdef SYMP_TRACE
+struct symp_trace *symp_core_trace(struct symp_core *core)
+{
+    return &core->trace;
+}
+#endif
+
+static inline float symp_peak(const float *buf, unsigned long count, int stride)
+{
+    unsigned long i;
+    float peak = 0.0f, v;
+
+    for (i = 0; i < count; i++) {
+        v = *buf < 0 ? -*buf : *buf;
+        if (v > peak) peak = v;
+        buf += stride;
+    }
+    return peak;
+}
+
+static float symp_comb_peak(const struct comb *comb)
+{
+    int i;
+    float peak = 0.0f;
+
+    for (i = 0; i < comb->size; i++) {
+        peak = fmaxf(peak, fabsf(comb_load(comb->buffer[i])));
+    }
+    return peak;
+}
+
+/* Called after a block with silent input: puts every comb to sleep whose
+ * buffer and state have decayed below DORMANT_THRESHOLD. */
+static void symp_core_update_dormant(struct symp_core *core)
+{
+    struct comb *comb;
+    int c = 0;
+
+    while (c < core->num_active) {
+        comb = core->active[c];
+        if (comb_state_level(comb->store) < DORMANT_THRESHOLD
+                && fabsf(comb->bp.low) < DORMANT_THRESHOLD
+                && fabsf(comb->bp.high) < DORMANT_THRESHOLD
+                && symp_comb_peak(comb) < DORMANT_THRESHOLD) {
+            memset(comb->buffer, 0, comb->size * sizeof(comb_sample));
+            comb->store = 0;
+            comb->bp.low = 0;
+            comb->bp.high = 0;
+            core->active[c] = core->active[--core->num_active];
+        }
+        else {
+            c++;
+        }
+    }
+}
+
+/* Writes or mixes one output sample at buf[pos] in the given format.
+ * Integer formats clamp to full scale, and the conversion and the sum with
+ * the existing sample are done in 64 bits, so nothing overflows where long
+ * is 32 bits, before saturating to the sample type. */
+static inline __attribute__((always_inline))
+void symp_core_store(void *buf, unsigned long pos, float v, int format, int add)
+{
+    int64_t s;
+
+    if (format == SYMP_CORE_FORMAT_S16) {
+        int16_t *p = (int16_t *)buf + pos;
+
+        v = fminf(fmaxf(v, -1.0f), 1.0f);
+        s = llrintf(v * 32768.0f);
+        if (add) s += *p;
+        if (s > INT16_MAX) s = INT16_MAX;
+        else if (s < INT16_MIN) s = INT16_MIN;
+        *p = s;
+    }
+    else if (format == SYMP_CORE_FORMAT_S32) {
+        int32_t *p = (int32_t *)buf + pos;
+
+        v = fminf(fmaxf(v, -1.0f), 1.0f);
+        s = llrintf(v * 2147483648.0f);
+        if (add) s += *p;
+        if (s > INT32_MAX) s = INT32_MAX;
+        else if (s < INT32_MIN) s = INT32_MIN;
+        *p = s;
+    }
+    else {
+        float *p = (float *)buf + pos;
+
+        if (add) *p += v;
+        else *p = v;
+    }
+}
+
+/* One sample of the band-pass, four multiplications and three additions */
+static inline __attribute__((always_inline))
+float symp_core_bandpass(const struct bandpass *bp, struct bandpass_state *st, float x)
+{
+    st->low = (x * bp->low1) + (st->low * bp->low2);
+    st->high = ((x - st->low) * bp->high1) + (st->high * bp->high2);
+    return st->high;
+}
+
+/* The kernels below take a constant filter argument, 0 gives the loops
+ * without the band-pass, 1 the ones that apply it where params.bandpass
+ * says. Never 1 in fixed point builds. */
+static inline int symp_core_filtered(const struct symp_core *core)
+{
+#ifdef SYMP_FIXED
+    return 0;
+#else
+    return core->params.bandpass & (SYMP_CORE_BANDPASS_INPUT | SYMP_CORE_BANDPASS_FEEDBACK);
+#endif
+}
+
+#ifndef SYMP_FIXED
+/* Advances all active combs by one sample with the input sample in, each
+ * with its own coefficients, and returns the sum of their outputs. With filter set, the damped sample
+ * goes through the band-pass before it is fed back. With meter set, the
+ * peak and the sum of squares of each comb's output are collected in
+ * comb->peak and comb->sumsq. */
+static inline __attribute__((always_inline))
+float symp_core_comb_step(struct symp_core *core, float in, int meter, int filter)
+{
+    float out = 0.0f, tmp, fb;
+    struct comb *comb;
+    int c;
+
+    for (c = 0; c < core->num_active; c++) {
+        comb = core->active[c];
+
+        tmp = comb_load(comb->buffer[comb->idx]);
+        comb->store = (tmp * comb->damp2) + (comb->store * comb->damp1);
+        fb = filter ? symp_core_bandpass(&core->bp, &comb->bp, comb->store) : comb->store;
+        comb->buffer[comb->idx] = comb_save(in + (fb * comb->feedback));
+        if (++comb->idx >= comb->size) {
+            comb->idx = 0;
+        }
+        out += tmp;
+
+        if (meter) {
+            comb->sumsq += tmp * tmp;
+            comb->peak = fmaxf(comb->peak, fabsf(tmp));
+        }
+    }
+    return out;
+}
+
+#ifdef SYMP_SCAN
+/* Samples per chunk of the scan kernel, and the width of its prefix
+ * groups */
+#define SCAN_CHUNK (256)
+#define SCAN_WIDTH (4)
+
+/* A one-pole recursion s[j] = b * u[j] + a * s[j - 1] over a group of
+ * SCAN_WIDTH samples is s[j] = sum(m[i][j] * u[i]) + pw[j] * s[-1], with
+ * m[i][j] = b * a^(j - i) for i <= j. A group is one vector, with the
+ * generic vector extension of the compiler. The damping and both halves
+ * of the band-pass are such recursions. */
+typedef float scan_vec __attribute__((vector_size(SCAN_WIDTH * sizeof(float))));
+
+struct scan_coefs {
+    scan_vec m[SCAN_WIDTH];
+    scan_vec pw;
+};
+
+static void symp_core_scan_coefs(struct scan_coefs *sc, float a, float b)
+{
+    float pw[SCAN_WIDTH + 1];
+    int i, j;
+
+    pw[0] = 1.0f;
+    for (j = 1; j <= SCAN_WIDTH; j++) {
+        pw[j] = pw[j - 1] * a;
+    }
+
+    memset(sc, 0, sizeof(struct scan_coefs));
+    for (j = 0; j < SCAN_WIDTH; j++) {
+        for (i = 0; i <= j; i++) {
+            sc->m[i][j] = b * pw[j - i];
+        }
+        sc->pw[j] = pw[j + 1];
+    }
+}
+
+/* One group of the recursion of sc over the samples in u, from the state
+ * in *s, which is advanced to the last result */
+static inline __attribute__((always_inline))
+scan_vec symp_core_scan_group(const struct scan_coefs *sc, scan_vec u, float *s)
+{
+    scan_vec v = sc->pw * *s;
+    int i;
+
+    for (i = 0; i < SCAN_WIDTH; i++) {
+        v += sc->m[i] * u[i];
+    }
+    *s = v[SCAN_WIDTH - 1];
+    return v;
+}
+
+/* The recursions of the scan kernel, the band-pass ones are only used
+ * with the band-pass in the feedback path */
+#define SCAN_DAMP (0)
+#define SCAN_LOW (1)
+#define SCAN_HIGH (2)
+
+/* Runs one comb over n samples, at most up to the end of its buffer, so
+ * that all comb outputs of the run are already in the buffer and only the
+ * damping and the band-pass are recursive. The outputs are read in one
+ * pass, the recursions are evaluated group by group, each group only
+ * depends on the previous one through the last value of each recursion,
+ * and the buffer is written and the output accumulated in another pass. */
+static inline __attribute__((always_inline))
+void symp_core_scan_comb(struct symp_core *core, struct comb *comb, const float *in,
+        float *out, int n, const struct scan_coefs *sc, int meter, int filter)
+{
+    float tmp[SCAN_CHUNK], st[SCAN_CHUNK];
+    comb_sample *buf = comb->buffer + comb->idx;
+    float store = comb->store;
+    struct bandpass_state bp = comb->bp;
+    scan_vec v, low;
+    int j, k;
+
+    for (j = 0; j < n; j++) {
+        tmp[j] = comb_load(buf[j]);
+    }
+
+    for (k = 0; k + SCAN_WIDTH <= n; k += SCAN_WIDTH) {
+        memcpy(&v, tmp + k, sizeof(v));
+        v = symp_core_scan_group(&sc[SCAN_DAMP], v, &store);
+        if (filter) {
+            low = symp_core_scan_group(&sc[SCAN_LOW], v, &bp.low);
+            v = symp_core_scan_group(&sc[SCAN_HIGH], v - low, &bp.high);
+        }
+        memcpy(st + k, &v, sizeof(v));
+    }
+    for (; k < n; k++) {
+        store = (tmp[k] * comb->damp2) + (store * comb->damp1);
+        st[k] = filter ? symp_core_bandpass(&core->bp, &bp, store) : store;
+    }
+    comb->store = store;
+    comb->bp = bp;
+
+    for (j = 0; j < n; j++) {
+        buf[j] = comb_save(in[j] + (st[j] * comb->feedback));
+        out[j] += tmp[j];
+    }
+    if (meter) {
+        for (j = 0; j < n; j++) {
+            comb->sumsq += tmp[j] * tmp[j];
+            comb->peak = fmaxf(comb->peak, fabsf(tmp[j]));
+        }
+    }
+
+    comb->idx += n;
+    if (comb->idx >= comb->size) {
+        comb->idx = 0;
+    }
+}
+
+/* The comb bank with SYMP_SCAN (make SCAN=1), comb by comb over chunks of
+ * up to SCAN_CHUNK samples instead of all combs sample by sample. Rounds
+ * differently from the serial recursion when damping or the band-pass is
+ * set. */
+static inline __attribute__((always_inline))
+void symp_core_combs(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add, int meter, int filter)
+{
+    float input_gain = core->params.input_gain;
+    float wet_left = core->params.wet_left;
+    float wet_right = core->params.wet_right;
+    int bp_in = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_INPUT);
+    int bp_fb = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_FEEDBACK);
+    float x[SCAN_CHUNK], y[SCAN_CHUNK];
+    float damp1 = -1.0f;
+    struct scan_coefs sc[3];
+    struct comb *comb;
+    unsigned long i, pos = 0;
+    int c, n, done, len;
+
+    if (bp_fb) {
+        symp_core_scan_coefs(&sc[SCAN_LOW], core->bp.low2, core->bp.low1);
+        symp_core_scan_coefs(&sc[SCAN_HIGH], core->bp.high2, core->bp.high1);
+    }
+
+    while (sample_count > 0) {
+        n = sample_count < SCAN_CHUNK ? sample_count : SCAN_CHUNK;
+
+        for (i = 0; i < n; i++) {
+            x[i] = *input * input_gain;
+            y[i] = 0.0f;
+            input += in_stride;
+        }
+        if (bp_in) {
+            for (i = 0; i < n; i++) {
+                x[i] = symp_core_bandpass(&core->bp, &core->in_bp, x[i]);
+            }
+        }
+
+        for (c = 0; c < core->num_active; c++) {
+            comb = core->active[c];
+            /* the damping of each comb, usually the same for all */
+            if (comb->damp1 != damp1) {
+                damp1 = comb->damp1;
+                symp_core_scan_coefs(&sc[SCAN_DAMP], comb->damp1, comb->damp2);
+            }
+            for (done = 0; done < n; done += len) {
+                len = comb->size - comb->idx;
+                if (len > n - done) len = n - done;
+                symp_core_scan_comb(core, comb, x + done, y + done, len, sc, meter, bp_fb);
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            if (add) {
+                if (wet_left > 0)
+                    symp_core_store(out1, pos, y[i] * adding_gain * wet_left, format, 1);
+                if (wet_right > 0)
+                    symp_core_store(out2, pos, y[i] * adding_gain * wet_right, format, 1);
+            } else {
+                symp_core_store(out1, pos, y[i] * wet_left, format, 0);
+                symp_core_store(out2, pos, y[i] * wet_right, format, 0);
+            }
+            pos += out_stride;
+        }
+        sample_count -= n;
+    }
+}
+
+#else
+
+/* The comb bank. Always inlined with constant add, meter, filter and
+ * format arguments, so that each combination gets its own loop without any
+ * extra branches. */
+static inline __attribute__((always_inline))
+void symp_core_combs(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add, int meter, int filter)
+{
+    float input_gain = core->params.input_gain;
+    float wet_left = core->params.wet_left;
+    float wet_right = core->params.wet_right;
+    int bp_in = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_INPUT);
+    int bp_fb = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_FEEDBACK);
+    float in, out;
+    unsigned long i, pos = 0;
+
+    for (i = 0; i < sample_count; i++) {
+        in = *input * input_gain;
+        if (bp_in) in = symp_core_bandpass(&core->bp, &core->in_bp, in);
+        out = symp_core_comb_step(core, in, meter, bp_fb);
+
+        if (add) {
+            if (wet_left > 0)
+                symp_core_store(out1, pos, out * adding_gain * wet_left, format, 1);
+            if (wet_right > 0)
+                symp_core_store(out2, pos, out * adding_gain * wet_right, format, 1);
+        } else {
+            symp_core_store(out1, pos, out * wet_left, format, 0);
+            symp_core_store(out2, pos, out * wet_right, format, 0);
+        }
+
+        input += in_stride;
+        pos += out_stride;
+    }
+}
+#endif
+
+#else
+
+/* The fixed point comb bank, see SYMP_FIXED. Metering converts each comb
+ * output to float, it does not influence the audio output. There is no
+ * band-pass, filter is always 0. */
+static inline __attribute__((always_inline))
+void symp_core_combs(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add, int meter, int filter)
+{
+    float input_gain = core->params.input_gain;
+    float gain = (add ? adding_gain : 1.0f) * (1.0f / FIXED_ONE);
+    float wet_left = core->params.wet_left * gain;
+    float wet_right = core->params.wet_right * gain;
+    comb_sample in, tmp;
+    int64_t out;
+    float level;
+    struct comb *comb;
+    unsigned long i, pos = 0;
+    int c;
+
+    for (i = 0; i < sample_count; i++) {
+        out = 0;
+        in = fixed_from_float(*input * input_gain);
+
+        for (c = 0; c < core->num_active; c++) {
+            comb = core->active[c];
+
+            tmp = comb->buffer[comb->idx];
+            comb->store = coef_shift((int64_t)tmp * comb->damp2 + (int64_t)comb->store * comb->damp1);
+            comb->buffer[comb->idx] = fixed_saturate(in
+                    + coef_shift((int64_t)comb->store * comb->feedback));
+            if (++comb->idx >= comb->size) {
+                comb->idx = 0;
+            }
+            out += tmp;
+
+            if (meter) {
+                level = comb_load(tmp);
+                comb->sumsq += level * level;
+                comb->peak = fmaxf(comb->peak, fabsf(level));
+            }
+        }
+
+        if (add) {
+            if (wet_left > 0)
+                symp_core_store(out1, pos, (float)out * wet_left, format, 1);
+            if (wet_right > 0)
+                symp_core_store(out2, pos, (float)out * wet_right, format, 1);
+        } else {
+            symp_core_store(out1, pos, (float)out * wet_left, format, 0);
+            symp_core_store(out2, pos, (float)out * wet_right, format, 0);
+        }
+
+        input += in_stride;
+        pos += out_stride;
+    }
+}
+#endif
+
+static inline __attribute__((always_inline))
+void symp_core_clear(void *out, int out_stride, int format, unsigned long sample_count)
+{
+    unsigned long i;
+
+    if (format == SYMP_CORE_FORMAT_FLOAT && out_stride == 1) {
+        memset(out, 0, sample_count * sizeof(float));
+        return;
+    }
+    for (i = 0; i < sample_count; i++) {
+        symp_core_store(out, i * out_stride, 0.0f, format, 0);
+    }
+}
+
+/* Loop modes of the combs, see symp_core_params.freeze and tail, and the
+ * number of samples the loop kernel runs at a time */
+#define LOOP_OFF (0)
+#define LOOP_TAIL (1)
+#define LOOP_FREEZE (2)
+#define LOOP_CHUNK (256)
+
+/* Adds n outputs of one comb to out, at most up to the end of its buffer.
+ * Without input and without the recursive filters, the buffer holds the
+ * next n outputs already: they are only read, and scaled by the tail gain
+ * for the next pass unless frozen. The samples are independent and the
+ * loop vectorises. */
+static inline __attribute__((always_inline))
+void symp_core_loop_comb(struct comb *comb, comb_acc *restrict out, int n, int meter,
+        int freeze)
+{
+    comb_sample *restrict buf = comb->buffer + comb->idx;
+    comb_coef gain = comb->tail_gain;
+    float level;
+    int j;
+
+    for (j = 0; j < n; j++) {
+        out[j] += comb_acc_load(buf[j]);
+        if (meter) {
+            level = comb_load(buf[j]);
+            comb->sumsq += level * level;
+            comb->peak = fmaxf(comb->peak, fabsf(level));
+        }
+        if (!freeze) buf[j] = comb_scale(buf[j], gain);
+    }
+
+    comb->idx += n;
+    if (comb->idx >= comb->size) {
+        comb->idx = 0;
+    }
+}
+
+/* Adds n outputs of every active comb to out. The damping state follows
+ * the last output, and the band-pass state that of a signal in its pass
+ * band, so that the recursion picks up from there when the loop ends. */
+static inline __attribute__((always_inline))
+void symp_core_loop_combs(struct symp_core *core, comb_acc *out, int n, int meter,
+        int freeze)
+{
+    struct comb *comb;
+    int c, done, len;
+
+    for (c = 0; c < core->num_active; c++) {
+        comb = core->active[c];
+        for (done = 0; done < n; done += len) {
+            len = comb->size - comb->idx;
+            if (len > n - done) len = n - done;
+            symp_core_loop_comb(comb, out + done, len, meter, freeze);
+        }
+        comb->store = comb_state_from(comb->buffer[comb->idx > 0 ? comb->idx - 1 : comb->size - 1]);
+#ifndef SYMP_FIXED
+        if (core->bandpass & SYMP_CORE_BANDPASS_FEEDBACK) {
+            comb->bp.low = 0;
+            comb->bp.high = comb->store;
+        }
+#endif
+    }
+}
+
+static void symp_core_loops(struct symp_core *core, comb_acc *out, int n, int loop)
+{
+    if (core->metering) {
+        if (loop == LOOP_FREEZE) symp_core_loop_combs(core, out, n, 1, 1);
+        else symp_core_loop_combs(core, out, n, 1, 0);
+    } else {
+        if (loop == LOOP_FREEZE) symp_core_loop_combs(core, out, n, 0, 1);
+        else symp_core_loop_combs(core, out, n, 0, 0);
+    }
+}
+
+/* The comb bank in a loop mode, in chunks of up to LOOP_CHUNK samples,
+ * the input is not read */
+static inline __attribute__((always_inline))
+void symp_core_looped(struct symp_core *core, void *out1, void *out2, int out_stride,
+        int format, unsigned long sample_count, float adding_gain, int add, int loop)
+{
+    float wet_left = core->params.wet_left * (add ? adding_gain : 1.0f) * ACC_SCALE;
+    float wet_right = core->params.wet_right * (add ? adding_gain : 1.0f) * ACC_SCALE;
+    comb_acc y[LOOP_CHUNK];
+    unsigned long i, n, pos = 0;
+
+    while (sample_count > 0) {
+        n = sample_count < LOOP_CHUNK ? sample_count : LOOP_CHUNK;
+
+        memset(y, 0, n * sizeof(comb_acc));
+        symp_core_loops(core, y, n, loop);
+
+        for (i = 0; i < n; i++) {
+            if (add) {
+                if (wet_left > 0)
+                    symp_core_store(out1, pos, (float)y[i] * wet_left, format, 1);
+                if (wet_right > 0)
+                    symp_core_store(out2, pos, (float)y[i] * wet_right, format, 1);
+            } else {
+                symp_core_store(out1, pos, (float)y[i] * wet_left, format, 0);
+                symp_core_store(out2, pos, (float)y[i] * wet_right, format, 0);
+            }
+            pos += out_stride;
+        }
+        sample_count -= n;
+    }
+}
+
+/* Keeps the replaced bank running without input, to be faded out by
+ * symp_core_fade() */
+static void symp_core_start_fade(struct symp_core *core, struct comb_bank *bank,
+        struct comb **active, int num_active)
+{
+    unsigned long len = __atomic_load_n(&core->crossfade, __ATOMIC_RELAXED);
+
+    symp_core_end_fade(core);
+    if (len == 0 || num_active == 0) {
+        symp_core_return_bank(core, bank);
+        return;
+    }
+
+    core->fade_bank = bank;
+    memcpy(core->fade_active, active, num_active * sizeof(struct comb *));
+    core->num_fade = num_active;
+    core->fade_len = len / core->decimation;
+    if (core->fade_len == 0) core->fade_len = 1;
+    core->fade_pos = 0;
+    core->fade_wet_left = core->params.wet_left;
+    core->fade_wet_right = core->params.wet_right;
+}
+
+/* Applies all posted changes, at the start of a block. The replaced combs
+ * go back in the same bank struct, so nothing is allocated or freed here. */
+static void symp_core_drain(struct symp_core *core)
+{
+    struct queue *cmds = &core->commands;
+    unsigned int head = __atomic_load_n(&cmds->head, __ATOMIC_ACQUIRE);
+    unsigned int tail = cmds->tail;
+    struct comb *combs[SYMP_CORE_MAX_STRINGS];
+    struct comb *active[SYMP_CORE_MAX_STRINGS];
+    struct comb_bank *bank;
+    struct message *msg;
+    int num_combs, num_active;
+
+    while (tail != head) {
+        msg = &cmds->msgs[tail & (QUEUE_SIZE - 1)];
+        bank = msg->bank;
+        if (bank) {
+            memcpy(combs, core->combs, sizeof(combs));
+            num_combs = core->num_combs;
+            memcpy(active, core->active, sizeof(active));
+            num_active = core->num_active;
+
+            memcpy(core->combs, bank->combs, sizeof(core->combs));
+            core->num_combs = bank->num_combs;
+            memcpy(bank->combs, combs, sizeof(combs));
+            bank->num_combs = num_combs;
+
+            memcpy(core->active, core->combs, sizeof(core->active));
+            core->num_active = core->num_combs;
+            symp_core_update_decay(core);
+
+            symp_core_start_fade(core, bank, active, num_active);
+        }
+        if (msg->has_params)
+            symp_core_set_params(core, &msg->params);
+        tail++;
+    }
+
+    __atomic_store_n(&cmds->tail, tail, __ATOMIC_RELEASE);
+}
+
+/* Runs the combs of the replaced bank without input and mixes them into
+ * the output with a linear fade out. Hands the bank back at the end. */
+#ifndef SYMP_FIXED
+static inline __attribute__((always_inline))
+float symp_core_fade_step(struct symp_core *core, int filter)
+{
+    float out = 0.0f, tmp, fb;
+    struct comb *comb;
+    int c;
+
+    for (c = 0; c < core->num_fade; c++) {
+        comb = core->fade_active[c];
+
+        tmp = comb_load(comb->buffer[comb->idx]);
+        comb->store = (tmp * comb->damp2) + (comb->store * comb->damp1);
+        fb = filter ? symp_core_bandpass(&core->bp, &comb->bp, comb->store) : comb->store;
+        comb->buffer[comb->idx] = comb_save(fb * comb->feedback);
+        if (++comb->idx >= comb->size) {
+            comb->idx = 0;
+        }
+        out += tmp;
+    }
+    return out;
+}
+
+static inline __attribute__((always_inline))
+void symp_core_fade(struct symp_core *core, void *out1, void *out2, int out_stride,
+        int format, unsigned long sample_count, float adding_gain, int add, int filter)
+{
+    int bp_fb = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_FEEDBACK);
+    float step = 1.0f / core->fade_len;
+    float gain = 1.0f - core->fade_pos * step;
+    float wet_left = core->fade_wet_left * (add ? adding_gain : 1.0f);
+    float wet_right = core->fade_wet_right * (add ? adding_gain : 1.0f);
+    float out;
+    unsigned long i, n, pos = 0;
+
+    n = core->fade_len - core->fade_pos;
+    if (n > sample_count) n = sample_count;
+
+    for (i = 0; i < n; i++) {
+        out = symp_core_fade_step(core, bp_fb) * gain;
+        gain -= step;
+        symp_core_store(out1, pos, out * wet_left, format, 1);
+        symp_core_store(out2, pos, out * wet_right, format, 1);
+        pos += out_stride;
+    }
+
+    core->fade_pos += n;
+    if (core->fade_pos >= core->fade_len)
+        symp_core_end_fade(core);
+}
+
+#else
+
+static inline __attribute__((always_inline))
+void symp_core_fade(struct symp_core *core, void *out1, void *out2, int out_stride,
+        int format, unsigned long sample_count, float adding_gain, int add, int filter)
+{
+    int64_t step = COEF_ONE / core->fade_len;
+    int64_t gain = COEF_ONE - (int64_t)core->fade_pos * step;
+    float scale = (add ? adding_gain : 1.0f) * (1.0f / FIXED_ONE);
+    float wet_left = core->fade_wet_left * scale;
+    float wet_right = core->fade_wet_right * scale;
+    comb_sample tmp;
+    int64_t out;
+    struct comb *comb;
+    unsigned long i, n, pos = 0;
+    int c;
+
+    n = core->fade_len - core->fade_pos;
+    if (n > sample_count) n = sample_count;
+
+    for (i = 0; i < n; i++) {
+        out = 0;
+
+        for (c = 0; c < core->num_fade; c++) {
+            comb = core->fade_active[c];
+
+            tmp = comb->buffer[comb->idx];
+            comb->store = coef_shift((int64_t)tmp * comb->damp2 + (int64_t)comb->store * comb->damp1);
+            comb->buffer[comb->idx] = coef_shift((int64_t)comb->store * comb->feedback);
+            if (++comb->idx >= comb->size) {
+                comb->idx = 0;
+            }
+            /* the gain goes on each comb, a Q1.30 gain times the sum of the
+             * bank could leave 64 bits */
+            out += coef_shift((int64_t)tmp * gain);
+        }
+
+        gain -= step;
+        symp_core_store(out1, pos, (float)out * wet_left, format, 1);
+        symp_core_store(out2, pos, (float)out * wet_right, format, 1);
+        pos += out_stride;
+    }
+
+    core->fade_pos += n;
+    if (core->fade_pos >= core->fade_len)
+        symp_core_end_fade(core);
+}
+#endif
+
+#ifndef SYMP_FIXED
+/* The comb bank at sample_rate / decimation, in chunks of up to
+ * DECIM_CHUNK samples: the input is copied behind the decimation history
+ * and only every decimation-th sample of the low-passed input is computed,
+ * then the combs run over the decimated chunk, and each output sample is
+ * interpolated with the taps of its phase from the comb outputs, instead of
+ * filtering a zero-stuffed signal. A crossfading bank runs at the decimated
+ * rate as well and is mixed in before the interpolation. In a loop mode,
+ * the input is not decimated and the loop kernel adds the comb outputs of
+ * the whole chunk. Returns the number of decimated samples. */
+static inline __attribute__((always_inline))
+unsigned long symp_core_decimated(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add, int meter, int filter,
+        int loop)
+{
+    int factor = core->decimation;
+    int len = DECIM_TAPS * factor;
+    int bp_in = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_INPUT);
+    int bp_fb = filter && (core->params.bandpass & SYMP_CORE_BANDPASS_FEEDBACK);
+    float input_gain = core->params.input_gain;
+    float wet_left = core->params.wet_left * (add ? adding_gain : 1.0f);
+    float wet_right = core->params.wet_right * (add ? adding_gain : 1.0f);
+    float fade_step = 0, fade_gain = 0;
+    float x[DECIM_TAPS * DECIM_MAX + DECIM_CHUNK];
+    float y[DECIM_TAPS + DECIM_CHUNK];
+    float in, out;
+    const float *taps;
+    unsigned long i, n, pos = 0, steps = 0;
+    int k, first, num_low, phase, last;
+
+    if (core->fade_bank) {
+        fade_step = 1.0f / core->fade_len;
+        fade_gain = 1.0f - core->fade_pos * fade_step;
+    }
+
+    while (sample_count > 0) {
+        n = sample_count < DECIM_CHUNK ? sample_count : DECIM_CHUNK;
+
+        memcpy(x, core->decim_hist, (len - 1) * sizeof(float));
+        for (i = 0; i < n; i++) {
+            x[len - 1 + i] = *input;
+            input += in_stride;
+        }
+        memcpy(y, core->interp_hist, DECIM_TAPS * sizeof(float));
+
+        /* decimate and run the combs, the first decimated sample is at the
+         * input sample that completes the current phase */
+        first = factor - 1 - core->decim_phase;
+        num_low = 0;
+        for (i = first; i < n; i += factor) {
+            out = 0.0f;
+            if (!loop) {
+                in = 0.0f;
+                for (k = 0; k < len; k++) {
+                    in += core->decim_taps[k] * x[i + k];
+                }
+
+                in *= input_gain;
+                if (bp_in) in = symp_core_bandpass(&core->bp, &core->in_bp, in);
+                out = symp_core_comb_step(core, in, meter, bp_fb);
+            }
+            if (core->fade_bank) {
+                out += symp_core_fade_step(core, bp_fb) * fade_gain;
+                fade_gain -= fade_step;
+                if (++core->fade_pos >= core->fade_len)
+                    symp_core_end_fade(core);
+            }
+            y[DECIM_TAPS + num_low++] = out;
+        }
+        if (loop && num_low > 0)
+            symp_core_loops(core, y + DECIM_TAPS, num_low, loop);
+
+        /* interpolate, last is the newest comb output for each sample */
+        phase = core->decim_phase;
+        last = DECIM_TAPS - 1;
+        for (i = 0; i < n; i++) {
+            if (++phase >= factor) {
+                phase = 0;
+                last++;
+            }
+            taps = core->interp_taps[phase];
+            out = 0.0f;
+            for (k = 0; k < DECIM_TAPS; k++) {
+                out += taps[k] * y[last - DECIM_TAPS + 1 + k];
+            }
+
+            if (add) {
+                if (wet_left > 0)
+                    symp_core_store(out1, pos, out * wet_left, format, 1);
+                if (wet_right > 0)
+                    symp_core_store(out2, pos, out * wet_right, format, 1);
+            } else {
+                symp_core_store(out1, pos, out * wet_left, format, 0);
+                symp_core_store(out2, pos, out * wet_right, format, 0);
+            }
+            pos += out_stride;
+        }
+
+        memcpy(core->decim_hist, x + n, (len - 1) * sizeof(float));
+        memcpy(core->interp_hist, y + num_low, DECIM_TAPS * sizeof(float));
+        core->decim_phase = phase;
+        steps += num_low;
+        sample_count -= n;
+    }
+
+    return steps;
+}
+#endif
+
+/* The modal strings, in chunks of up to MODAL_CHUNK samples: the scaled
+ * input is gathered into a buffer, the strings write the sum of their
+ * outputs into another, which is then mixed into the output. The band-pass
+ * in the feedback path is part of the coefficients of the partials. */
+static inline __attribute__((always_inline))
+void symp_core_modal(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add)
+{
+    float input_gain = core->params.input_gain;
+    float wet_left = core->params.wet_left * (add ? adding_gain : 1.0f);
+    float wet_right = core->params.wet_right * (add ? adding_gain : 1.0f);
+    int bp_in = core->params.bandpass & SYMP_CORE_BANDPASS_INPUT;
+    float x[MODAL_CHUNK], y[MODAL_CHUNK];
+    unsigned long i, n, pos = 0;
+
+    while (sample_count > 0) {
+        n = sample_count < MODAL_CHUNK ? sample_count : MODAL_CHUNK;
+
+        for (i = 0; i < n; i++) {
+            x[i] = *input * input_gain;
+            input += in_stride;
+        }
+        if (bp_in) {
+            for (i = 0; i < n; i++) {
+                x[i] = symp_core_bandpass(&core->bp, &core->in_bp, x[i]);
+            }
+        }
+        symp_modal_process(&core->modal, x, y, n, core->metering);
+
+        for (i = 0; i < n; i++) {
+            if (add) {
+                if (wet_left > 0)
+                    symp_core_store(out1, pos, y[i] * wet_left, format, 1);
+                if (wet_right > 0)
+                    symp_core_store(out2, pos, y[i] * wet_right, format, 1);
+            } else {
+                symp_core_store(out1, pos, y[i] * wet_left, format, 0);
+                symp_core_store(out2, pos, y[i] * wet_right, format, 0);
+            }
+            pos += out_stride;
+        }
+        sample_count -= n;
+    }
+}
+
+/* The block with the modal engine, the counterpart of the comb part of
+ * symp_core_run() */
+static inline __attribute__((always_inline))
+void symp_core_run_modal(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add, int silent)
+{
+    struct symp_modal *modal = &core->modal;
+    int i;
+
+    if (!silent && modal->num_active < modal->num_strings)
+        symp_modal_wake(modal);
+
+    if (core->metering) {
+        for (i = 0; i < modal->num_strings; i++) {
+            modal->strings[i].peak = 0;
+            modal->strings[i].sumsq = 0;
+        }
+    }
+    core->last_sample_count = sample_count;
+
+    TRACE_PHASE(&core->trace, "modal bank and mix");
+
+    if (modal->num_active > 0) {
+        if (core->metering)
+            TRACE_KERNEL(&core->trace, "modal, metering");
+        else
+            TRACE_KERNEL(&core->trace, "modal");
+        symp_core_modal(core, input, in_stride, out1, out2, out_stride, format,
+                sample_count, adding_gain, add);
+
+        if (silent) {
+            TRACE_PHASE(&core->trace, "dormancy check");
+            symp_modal_update_dormant(modal, DORMANT_THRESHOLD);
+        }
+    }
+    else {
+        TRACE_KERNEL(&core->trace, "idle");
+        if (!add) {
+            symp_core_clear(out1, out_stride, format, sample_count);
+            symp_core_clear(out2, out_stride, format, sample_count);
+        }
+    }
+}
+
+/* The comb part of symp_core_run(), once with and once without the
+ * band-pass. Frozen combs can not decay and are not checked for
+ * dormancy. */
+static inline __attribute__((always_inline))
+void symp_core_run_combs(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add, int filter, int silent,
+        int loop)
+{
+#ifndef SYMP_FIXED
+    if (core->decimation > 1 && (core->num_active > 0 || core->fade_bank)) {
+        if (core->metering) {
+            TRACE_KERNEL(&core->trace, filter ? "decimated, band-pass, metering" STORAGE_SUFFIX
+                    : "decimated, metering" STORAGE_SUFFIX);
+            core->last_sample_count = symp_core_decimated(core, input, in_stride,
+                    out1, out2, out_stride, format, sample_count, adding_gain, add, 1, filter,
+                    loop);
+        }
+        else {
+            TRACE_KERNEL(&core->trace, filter ? "decimated, band-pass" STORAGE_SUFFIX
+                    : "decimated" STORAGE_SUFFIX);
+            core->last_sample_count = symp_core_decimated(core, input, in_stride,
+                    out1, out2, out_stride, format, sample_count, adding_gain, add, 0, filter,
+                    loop);
+        }
+
+        if (silent && loop != LOOP_FREEZE) {
+            TRACE_PHASE(&core->trace, "dormancy check");
+            symp_core_update_dormant(core);
+        }
+        return;
+    }
+#endif
+
+    if (core->num_active > 0) {
+        if (loop) {
+            TRACE_KERNEL(&core->trace, loop == LOOP_FREEZE ? "freeze" STORAGE_SUFFIX
+                    : "tail" STORAGE_SUFFIX);
+            symp_core_looped(core, out1, out2, out_stride, format, sample_count,
+                    adding_gain, add, loop);
+        }
+        else if (core->metering) {
+            TRACE_KERNEL(&core->trace, filter ? KERNEL_NAME ", band-pass, metering" STORAGE_SUFFIX
+                    : KERNEL_NAME ", metering" STORAGE_SUFFIX);
+            symp_core_combs(core, input, in_stride, out1, out2, out_stride, format,
+                    sample_count, adding_gain, add, 1, filter);
+        }
+        else {
+            TRACE_KERNEL(&core->trace, filter ? KERNEL_NAME ", band-pass" STORAGE_SUFFIX
+                    : KERNEL_NAME STORAGE_SUFFIX);
+            symp_core_combs(core, input, in_stride, out1, out2, out_stride, format,
+                    sample_count, adding_gain, add, 0, filter);
+        }
+
+        if (silent && loop != LOOP_FREEZE) {
+            TRACE_PHASE(&core->trace, "dormancy check");
+            symp_core_update_dormant(core);
+        }
+    }
+    else if (!add) {
+        /* idle, all combs are dormant */
+        TRACE_KERNEL(&core->trace, "idle");
+        symp_core_clear(out1, out_stride, format, sample_count);
+        symp_core_clear(out2, out_stride, format, sample_count);
+    }
+    else {
+        TRACE_KERNEL(&core->trace, "idle");
+    }
+
+    if (core->fade_bank) {
+        TRACE_PHASE(&core->trace, "crossfade");
+        symp_core_fade(core, out1, out2, out_stride, format, sample_count, adding_gain, add,
+                filter);
+    }
+}
+
+static inline __attribute__((always_inline))
+void symp_core_run(struct symp_core *core, const float *input, int in_stride,
+        void *out1, void *out2, int out_stride, int format,
+        unsigned long sample_count, float adding_gain, int add)
+{
+    float input_gain;
+    int c, silent, loop;
+
+    if (core->commands.tail != __atomic_load_n(&core->commands.head, __ATOMIC_RELAXED))
+        symp_core_drain(core);
+    input_gain = core->params.input_gain;
+
+    TRACE_PHASE(&core->trace, "input scan");
+
+    /* the input band-pass may still ring out into the strings */
+    silent = symp_peak(input, sample_count, in_stride) * (input_gain < 0 ? -input_gain : input_gain)
+        < DORMANT_THRESHOLD && fabsf(core->in_bp.low) < DORMANT_THRESHOLD
+        && fabsf(core->in_bp.high) < DORMANT_THRESHOLD;
+
+    if (core->engine == SYMP_CORE_ENGINE_MODAL) {
+        symp_core_run_modal(core, input, in_stride, out1, out2, out_stride, format,
+                sample_count, adding_gain, add, silent);
+        return;
+    }
+
+    /* frozen combs take no input, dormant ones stay asleep. Fixed point
+     * builds have no tail, its gain is not bit-exact. */
+#ifdef SYMP_FIXED
+    loop = core->params.freeze ? LOOP_FREEZE : LOOP_OFF;
+#else
+    loop = core->params.freeze ? LOOP_FREEZE
+        : core->params.tail && silent ? LOOP_TAIL : LOOP_OFF;
+#endif
+
+    if (!silent && loop != LOOP_FREEZE && core->num_active < core->num_combs) {
+        memcpy(core->active, core->combs, sizeof(core->active));
+        core->num_active = core->num_combs;
+    }
+
+    if (core->metering) {
+        for (c = 0; c < core->num_combs; c++) {
+            core->combs[c]->peak = 0;
+            core->combs[c]->sumsq = 0;
+        }
+    }
+    core->last_sample_count = sample_count;
+
+    TRACE_PHASE(&core->trace, "comb bank and mix");
+
+    if (symp_core_filtered(core))
+        symp_core_run_combs(core, input, in_stride, out1, out2, out_stride, format,
+                sample_count, adding_gain, add, 1, silent, loop);
+    else
+        symp_core_run_combs(core, input, in_stride, out1, out2, out_stride, format,
+                sample_count, adding_gain, add, 0, silent, loop);
+}
+
+void symp_core_process(struct symp_core *core, const float *input,
+        float *out_left, float *out_right, unsigned long sample_count)
+{
+    symp_core_run(core, input, 1, out_left, out_right, 1, SYMP_CORE_FORMAT_FLOAT,
+            sample_count, 1.0f, 0);
+}
+
+void symp_core_process_adding(struct symp_core *core, const float *input,
+        float *out_left, float *out_right, unsigned long sample_count, float gain)
+{
+    symp_core_run(core, input, 1, out_left, out_right, 1, SYMP_CORE_FORMAT_FLOAT,
+            sample_count, gain, 1);
+}
+
+/* One instance of the kernel per output format and mode */
+#define STRIDED_RUN(format, add) \
+    symp_core_run(core, input, input_stride, out_left, out_right, output_stride, \
+            format, sample_count, gain, add)
+
+void symp_core_process_strided(struct symp_core *core, const float *input,
+        int input_stride, void *out_left, void *out_right, int output_stride,
+        int format, unsigned long sample_count, int add, float gain)
+{
+    switch (format) {
+        case SYMP_CORE_FORMAT_S16:
+            if (add) STRIDED_RUN(SYMP_CORE_FORMAT_S16, 1);
+            else STRIDED_RUN(SYMP_CORE_FORMAT_S16, 0);
+            break;
+        case SYMP_CORE_FORMAT_S32:
+            if (add) STRIDED_RUN(SYMP_CORE_FORMAT_S32, 1);
+            else STRIDED_RUN(SYMP_CORE_FORMAT_S32, 0);
+            break;
+        default:
+            if (add) STRIDED_RUN(SYMP_CORE_FORMAT_FLOAT, 1);
+            else STRIDED_RUN(SYMP_CORE_FORMAT_FLOAT, 0);
+            break;
+    }
+}
@@ -0,0 +1,223 @@
+/* Sympathetic string resonator core
+ *
+ * The comb filter engine of the sympathetic string reverb, without any
+ * LADSPA glue, for direct use from a synth engine. Built as libsympcore.a
+ * and libsympcore.so; the LADSPA plugin is a thin wrapper around it.
+ *
+ * Usage: create an instance for a sample rate, configure the string tunings
+ * (allocates, not real-time safe), then set the parameters and process
+ * blocks from the audio thread. Parameters have the same ranges and meaning
+ * as the control ports of the plugin.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_CORE_H
+#define SYMP_CORE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* incremented on every incompatible change of this API */
+#define SYMP_CORE_API_VERSION (4)
+
+#define SYMP_CORE_MAX_STRINGS (11)
+
+/* output sample formats of symp_core_process_strided(), integer formats
+ * have their full scale at 1.0 */
+#define SYMP_CORE_FORMAT_FLOAT (0)
+#define SYMP_CORE_FORMAT_S16 (1)
+#define SYMP_CORE_FORMAT_S32 (2)
+
+/* where the band-pass of symp_core_params is applied, either or both */
+#define SYMP_CORE_BANDPASS_INPUT (1)
+#define SYMP_CORE_BANDPASS_FEEDBACK (2)
+
+/* where the feedback and damping of each string come from, see
+ * symp_core_params.decay */
+#define SYMP_CORE_DECAY_GLOBAL (0)
+#define SYMP_CORE_DECAY_STRINGS (1)
+#define SYMP_CORE_DECAY_RT60 (2)
+
+/* string models, see symp_core_set_engine() */
+#define SYMP_CORE_ENGINE_COMB (0)
+#define SYMP_CORE_ENGINE_MODAL (1)
+
+struct symp_core;
+
+struct symp_core_config {
+    /* string tunings in Hz, strings tuned to 0 or below are disabled */
+    float tunings[SYMP_CORE_MAX_STRINGS];
+};
+
+struct symp_core_params {
+    float feedback;     /* 0 to 1 */
+    float damping;      /* 0 to 1 */
+    float input_gain;
+    float wet_left;     /* 0 to 1 */
+    float wet_right;    /* 0 to 1 */
+
+    /* A first-order band-pass, a high-pass at bandpass_low and a low-pass
+     * at bandpass_high, in Hz, either 0 for no cutoff on that side. Applied
+     * to the input of the strings and/or after the damping in the feedback
+     * path of each string, as given by the SYMP_CORE_BANDPASS_* flags in
+     * bandpass, 0 for off. Runs inside the comb loop, at the rate of the
+     * strings. Not available in fixed point builds. */
+    float bandpass_low;
+    float bandpass_high;
+    int bandpass;
+
+    /* With SYMP_CORE_DECAY_GLOBAL (0), all strings use feedback and
+     * damping. With SYMP_CORE_DECAY_STRINGS, each string uses its own
+     * string_feedback and string_damping, by string number, with the same
+     * ranges. With SYMP_CORE_DECAY_RT60, all strings use damping, and the
+     * feedback of each string is derived from its length, so that its
+     * fundamental decays by 60 dB in rt60 seconds, whatever its tuning. An
+     * rt60 of 0 or below falls back to feedback, as does RT60 in fixed
+     * point builds, whose coefficients must not depend on libm. */
+    int decay;
+    float string_feedback[SYMP_CORE_MAX_STRINGS];
+    float string_damping[SYMP_CORE_MAX_STRINGS];
+    float rt60;
+
+    /* With freeze set, the input is no longer fed to the strings and each
+     * string repeats the period in its delay line unchanged, forever,
+     * which costs no more than reading it. With tail set, once the input
+     * is silent, each string repeats its period with the loop gain at its
+     * fundamental applied once per pass, instead of running the damping
+     * and the band-pass, until the input returns. The tail keeps the
+     * decay time of the fundamental, the upper harmonics decay with it.
+     * Both take effect at the next block and continue from the current
+     * contents of the strings, without a step in the output. Comb engine
+     * only, the modal engine ignores them. Fixed point builds ignore tail,
+     * for the same reason as RT60. */
+    int freeze;
+    int tail;
+};
+
+struct symp_core_stats {
+    int num_strings;    /* tuned strings */
+    int num_active;     /* tuned strings that are not dormant */
+
+    /* levels of each string over the last block, by string number. Only
+     * collected while metering is enabled, otherwise 0. */
+    float peak[SYMP_CORE_MAX_STRINGS];
+    float rms[SYMP_CORE_MAX_STRINGS];
+};
+
+/* Returns SYMP_CORE_API_VERSION of the library, for checking against the
+ * header a caller was built with */
+int symp_core_api_version(void);
+
+struct symp_core *symp_core_create(unsigned long sample_rate);
+void symp_core_destroy(struct symp_core *core);
+
+/* Sets up the strings for the given tunings, with silent state. A NULL
+ * config releases all strings. Allocates memory, returns -1 if out of
+ * memory, in which case the core has no strings. */
+int symp_core_configure(struct symp_core *core, const struct symp_core_config *config);
+
+/* Runs the strings at sample_rate / factor, for a factor of 1 (the
+ * default), 2 or 4. The input is decimated and the output interpolated
+ * with short polyphase filters, which adds a latency of about 8 * factor samples
+ * and limits the strings to below 0.4 times the decimated rate. The comb
+ * buffers shrink by the factor, and the tunings are rounded to whole
+ * samples at the decimated rate. Only possible while the core has no
+ * strings, i.e. before symp_core_configure() or after configuring it with
+ * NULL, and not in fixed point builds. Returns -1 otherwise. */
+int symp_core_set_decimation(struct symp_core *core, int factor);
+
+/* Selects the string model: SYMP_CORE_ENGINE_COMB (the default, and the
+ * reference) or SYMP_CORE_ENGINE_MODAL, which models each string as eight
+ * resonators at its first harmonics, with the same decay and peak gain as
+ * the comb harmonics. The modal engine needs no memory per string, only
+ * rings at the harmonics and always runs at the full rate. It can not
+ * change the tunings with symp_core_post() and does not support snapshots.
+ * Like the decimation, only possible while the core has no strings and not
+ * in fixed point builds. Returns -1 otherwise. */
+int symp_core_set_engine(struct symp_core *core, int engine);
+
+/* Silences all strings, keeping the configuration. Real-time safe. */
+void symp_core_reset(struct symp_core *core);
+
+/* Queues new tunings and/or parameters from a non-real-time thread, either
+ * may be NULL. The combs for the new tunings are allocated here. The audio
+ * thread applies everything posted so far at the start of the next block,
+ * without allocating, and hands the replaced combs back. Returns -1 if out
+ * of memory or if too many changes are in flight. Only one thread at a time
+ * may post. */
+int symp_core_post(struct symp_core *core, const struct symp_core_config *config,
+        const struct symp_core_params *params);
+
+/* Length of the crossfade when symp_core_post() changes the tunings, in
+ * samples. The replaced strings keep ringing without input and are faded
+ * out while the new ones build up. 0 switches instantly, the default is
+ * 20 ms. Takes effect with the next change. */
+void symp_core_set_crossfade(struct symp_core *core, unsigned long sample_count);
+
+/* Frees the combs handed back by the audio thread. Done by every
+ * symp_core_post(), call it from the posting thread to release memory
+ * earlier. */
+void symp_core_collect(struct symp_core *core);
+
+/* Returns 1 if the audio thread has handed back combs that
+ * symp_core_collect() would free, 0 otherwise. Real-time safe, for the
+ * audio thread to ask the posting thread to collect them. */
+int symp_core_collect_pending(const struct symp_core *core);
+
+/* Real-time safe, takes effect with the next processed block */
+void symp_core_set_params(struct symp_core *core, const struct symp_core_params *params);
+void symp_core_set_metering(struct symp_core *core, int enabled);
+
+/* Processes a block of mono input into two output channels, either
+ * replacing the output or adding to it with the given gain. */
+void symp_core_process(struct symp_core *core, const float *input,
+        float *out_left, float *out_right, unsigned long sample_count);
+void symp_core_process_adding(struct symp_core *core, const float *input,
+        float *out_left, float *out_right, unsigned long sample_count, float gain);
+
+/* Like the above, but reads and writes strided buffers directly, e.g. the
+ * interleaved frames of an ALSA mmap area. Strides are in samples of the
+ * respective format, 2 for interleaved stereo. The output is converted to
+ * the given format, integer formats saturate, also when adding. */
+void symp_core_process_strided(struct symp_core *core, const float *input,
+        int input_stride, void *out_left, void *out_right, int output_stride,
+        int format, unsigned long sample_count, int add, float gain);
+
+/* Copies the complete string state, including the comb buffers, the
+ * decimation filter histories and the current parameters, into buf.
+ * Returns the number of bytes written, or -1 if size is smaller than
+ * symp_core_snapshot_size() or with the modal engine. Real-time safe. */
+size_t symp_core_snapshot_size(const struct symp_core *core);
+long symp_core_snapshot(const struct symp_core *core, void *buf, size_t size);
+
+/* Restores a snapshot taken from a core with the same sample rate,
+ * decimation and tunings, returns -1 if it does not match. Real-time safe. */
+int symp_core_restore(struct symp_core *core, const void *buf, size_t size);
+
+int symp_core_num_active(const struct symp_core *core);
+void symp_core_get_stats(const struct symp_core *core, struct symp_core_stats *stats);
+
+/* Snapshot and restore of a LADSPA plugin instance, exported by the plugin
+ * and looked up by the benchmark. symp_snapshot() with a NULL buffer returns
+ * the size of a snapshot. */
+#define SYMP_SNAPSHOT_SYMBOL "symp_snapshot"
+#define SYMP_RESTORE_SYMBOL "symp_restore"
+
+typedef long (*symp_snapshot_function)(void *handle, void *buf, size_t size);
+typedef int (*symp_restore_function)(void *handle, const void *buf, size_t size);
+
+#ifdef SYMP_TRACE
+/* The phase trace of the last processed block, see trace.h. The caller
+ * marks the start and end of a block with TRACE_BEGIN and TRACE_END. */
+struct symp_trace *symp_core_trace(struct symp_core *core);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
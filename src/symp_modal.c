@@ -0,0 +1,260 @@
+/* Modal string engine, see symp_modal.h
+ *
+ * Each partial decays like the harmonic of the comb filter it replaces: per
+ * period of the string, it loses the feedback gain times the response of
+ * the damping low-pass at its frequency, and of the band-pass in the
+ * feedback path if there is one. The input gain of each resonator
+ * gives it the same peak gain as the comb at that harmonic. The tunings are
+ * not rounded to whole samples like the comb lengths.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "symp_modal.h"
+
+/* highest partial frequency, as a fraction of the sample rate */
+#define MODAL_MAX_FREQ (0.45f)
+
+/* Computes the coefficients of the partials in block b */
+static void symp_modal_block_coefs(struct symp_modal *modal, int b)
+{
+    float freq = modal->order[b]->freq;
+    float period = modal->sample_rate / freq;
+    float feedback = modal->order[b]->feedback;
+    float damping = modal->order[b]->damping;
+    float low = modal->low;
+    float high = modal->high;
+    float w, c, g, r;
+    int k, m;
+
+    for (k = 0; k < MODAL_PARTIALS; k++) {
+        m = b * MODAL_PARTIALS + k;
+        if (freq * (k + 1) >= MODAL_MAX_FREQ * modal->sample_rate) {
+            modal->b0[m] = 0;
+            modal->a1[m] = 0;
+            modal->a2[m] = 0;
+            continue;
+        }
+        w = 2 * M_PI * freq * (k + 1) / modal->sample_rate;
+        c = cosf(w);
+        g = feedback * (1 - damping) / sqrtf(1 - 2 * damping * c + damping * damping);
+        /* the magnitudes of the high-pass and the low-pass of the band-pass */
+        if (low < 1)
+            g *= low * sqrtf(2 - 2 * c) / sqrtf(1 - 2 * low * c + low * low);
+        if (high > 0)
+            g *= (1 - high) / sqrtf(1 - 2 * high * c + high * high);
+        /* out of range feedback or damping would give a NaN or a growing
+         * pole */
+        g = fminf(fmaxf(g, 0.0f), MODAL_MAX_GAIN);
+        r = powf(g, 1.0f / period);
+
+        modal->a1[m] = 2 * r * c;
+        modal->a2[m] = r * r;
+        /* a peak gain of 1 / (1 - g) */
+        modal->b0[m] = (1 - r) * sqrtf(1 - 2 * r * cosf(2 * w) + r * r) / (1 - g);
+    }
+}
+
+void symp_modal_configure(struct symp_modal *modal, unsigned long sample_rate,
+        const struct symp_core_config *config)
+{
+    struct modal_string *str;
+    int i;
+
+    memset(modal->strings, 0, sizeof(modal->strings));
+    memset(modal->b0, 0, sizeof(modal->b0));
+    memset(modal->a1, 0, sizeof(modal->a1));
+    memset(modal->a2, 0, sizeof(modal->a2));
+    modal->num_strings = 0;
+    modal->sample_rate = sample_rate;
+
+    for (i = 0; config && i < SYMP_CORE_MAX_STRINGS; i++) {
+        if (config->tunings[i] <= 0) continue;
+
+        str = &modal->strings[modal->num_strings];
+        str->freq = config->tunings[i];
+        str->string = i;
+        modal->order[modal->num_strings] = str;
+        modal->num_strings++;
+    }
+
+    symp_modal_reset(modal);
+}
+
+void symp_modal_set_coefs(struct symp_modal *modal, const float *feedback,
+        const float *damping, float low, float high)
+{
+    struct modal_string *str;
+    int b;
+
+    for (b = 0; b < modal->num_strings; b++) {
+        str = &modal->strings[b];
+        str->feedback = feedback[str->string];
+        str->damping = damping[str->string];
+    }
+    modal->low = low;
+    modal->high = high;
+    for (b = 0; b < modal->num_strings; b++) {
+        symp_modal_block_coefs(modal, b);
+    }
+}
+
+void symp_modal_reset(struct symp_modal *modal)
+{
+    int i;
+
+    memset(modal->y1, 0, sizeof(modal->y1));
+    memset(modal->y2, 0, sizeof(modal->y2));
+    for (i = 0; i < modal->num_strings; i++) {
+        modal->strings[i].peak = 0;
+        modal->strings[i].sumsq = 0;
+    }
+    modal->num_active = modal->num_strings;
+}
+
+/* The dormant blocks keep their coefficients and have silent state */
+void symp_modal_wake(struct symp_modal *modal)
+{
+    modal->num_active = modal->num_strings;
+}
+
+static void swap_lanes(float *lanes, int a, int b)
+{
+    float tmp[MODAL_PARTIALS];
+
+    memcpy(tmp, lanes + a * MODAL_PARTIALS, sizeof(tmp));
+    memcpy(lanes + a * MODAL_PARTIALS, lanes + b * MODAL_PARTIALS, sizeof(tmp));
+    memcpy(lanes + b * MODAL_PARTIALS, tmp, sizeof(tmp));
+}
+
+/* Moves a silent block behind the last active one */
+static void symp_modal_sleep(struct symp_modal *modal, int b)
+{
+    int last = --modal->num_active;
+    struct modal_string *str = modal->order[b];
+
+    memset(modal->y1 + b * MODAL_PARTIALS, 0, MODAL_PARTIALS * sizeof(float));
+    memset(modal->y2 + b * MODAL_PARTIALS, 0, MODAL_PARTIALS * sizeof(float));
+    if (b == last) return;
+
+    swap_lanes(modal->b0, b, last);
+    swap_lanes(modal->a1, b, last);
+    swap_lanes(modal->a2, b, last);
+    swap_lanes(modal->y1, b, last);
+    swap_lanes(modal->y2, b, last);
+    modal->order[b] = modal->order[last];
+    modal->order[last] = str;
+}
+
+void symp_modal_update_dormant(struct symp_modal *modal, float threshold)
+{
+    float level;
+    int b = 0, m;
+
+    while (b < modal->num_active) {
+        level = 0.0f;
+        for (m = b * MODAL_PARTIALS; m < (b + 1) * MODAL_PARTIALS; m++) {
+            level = fmaxf(level, fmaxf(fabsf(modal->y1[m]), fabsf(modal->y2[m])));
+        }
+        if (level < threshold)
+            symp_modal_sleep(modal, b);
+        else
+            b++;
+    }
+}
+
+/* Sample by sample over all active lanes. The lanes have no dependencies
+ * between each other, the compiler vectorises the inner loop and the
+ * latency of each recursion is hidden behind the others. Metering sums the
+ * lanes of each string once more. */
+static inline __attribute__((always_inline))
+void symp_modal_run(struct symp_modal *modal, const float *input, float *output,
+        unsigned long sample_count, int meter)
+{
+    float *restrict b0 = modal->b0;
+    float *restrict a1 = modal->a1;
+    float *restrict a2 = modal->a2;
+    float *restrict y1 = modal->y1;
+    float *restrict y2 = modal->y2;
+    int lanes = modal->num_active * MODAL_PARTIALS;
+    struct modal_string *str;
+    float x, y, out;
+    unsigned long i;
+    int b, m;
+
+    for (i = 0; i < sample_count; i++) {
+        x = input[i];
+        out = 0.0f;
+        for (m = 0; m < lanes; m++) {
+            y = b0[m] * x + a1[m] * y1[m] - a2[m] * y2[m];
+            y2[m] = y1[m];
+            y1[m] = y;
+            out += y;
+        }
+        output[i] = out;
+
+        if (meter) {
+            for (b = 0; b < modal->num_active; b++) {
+                str = modal->order[b];
+                out = 0.0f;
+                for (m = b * MODAL_PARTIALS; m < (b + 1) * MODAL_PARTIALS; m++) {
+                    out += y1[m];
+                }
+                str->sumsq += out * out;
+                str->peak = fmaxf(str->peak, fabsf(out));
+            }
+        }
+    }
+}
+
+/* Without metering, each lane runs over MODAL_STEPS samples at a time with
+ * its state in registers, which saves most of the loads and stores of the
+ * state. The rest of the chunk goes through symp_modal_run(). */
+#define MODAL_STEPS (4)
+
+static void symp_modal_run_steps(struct symp_modal *modal, const float *input,
+        float *output)
+{
+    float *restrict b0 = modal->b0;
+    float *restrict a1 = modal->a1;
+    float *restrict a2 = modal->a2;
+    float *restrict y1 = modal->y1;
+    float *restrict y2 = modal->y2;
+    int lanes = modal->num_active * MODAL_PARTIALS;
+    float out[MODAL_STEPS];
+    float p1, p2, y;
+    int m, j;
+
+    memset(out, 0, sizeof(out));
+    for (m = 0; m < lanes; m++) {
+        p1 = y1[m];
+        p2 = y2[m];
+        for (j = 0; j < MODAL_STEPS; j++) {
+            y = b0[m] * input[j] + a1[m] * p1 - a2[m] * p2;
+            p2 = p1;
+            p1 = y;
+            out[j] += y;
+        }
+        y1[m] = p1;
+        y2[m] = p2;
+    }
+    memcpy(output, out, sizeof(out));
+}
+
+void symp_modal_process(struct symp_modal *modal, const float *input, float *output,
+        unsigned long sample_count, int meter)
+{
+    unsigned long i = 0;
+
+    if (meter) {
+        symp_modal_run(modal, input, output, sample_count, 1);
+        return;
+    }
+    for (; i + MODAL_STEPS <= sample_count; i += MODAL_STEPS) {
+        symp_modal_run_steps(modal, input + i, output + i);
+    }
+    symp_modal_run(modal, input + i, output + i, sample_count - i, 0);
+}
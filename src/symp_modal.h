@@ -0,0 +1,93 @@
+/* Modal string engine
+ *
+ * The alternative to the comb filters of symp_core.c, selected with
+ * symp_core_set_engine(). Each string is a bank of MODAL_PARTIALS two-pole
+ * resonators at its first harmonics. The partials of all strings are lanes
+ * of the same arrays and are processed together, sample by sample, so that
+ * the recursions of the lanes are independent and vectorise. The memory use
+ * is fixed, whatever the tunings. Only used by the core, not part of its
+ * API.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_MODAL_H
+#define SYMP_MODAL_H
+
+#include "symp_core.h"
+
+#define MODAL_PARTIALS (8)
+
+/* Number of samples the core hands to symp_modal_process() at a time */
+#define MODAL_CHUNK (128)
+
+#define MODAL_LANES (SYMP_CORE_MAX_STRINGS * MODAL_PARTIALS)
+
+/* upper bound of the gain per period of a partial, the largest feedback
+ * of the combs (RT60_MAX_FEEDBACK in symp_core.c) */
+#define MODAL_MAX_GAIN (0.999f)
+
+/* feedback and damping are the feedback gain per period and the damping
+ * low-pass coefficient of the comb filter that the string follows */
+struct modal_string {
+    float freq;
+    int string;
+    float feedback;
+    float damping;
+    float peak;
+    float sumsq;
+};
+
+struct symp_modal {
+    struct modal_string strings[SYMP_CORE_MAX_STRINGS];
+    int num_strings;
+
+    /* coefficients and state of the partials, block b of MODAL_PARTIALS
+     * lanes belongs to order[b]. The first num_active blocks are processed,
+     * the others are dormant. Partials above 0.45 times the sample rate
+     * have all coefficients at 0. */
+    float b0[MODAL_LANES];
+    float a1[MODAL_LANES];
+    float a2[MODAL_LANES];
+    float y1[MODAL_LANES];
+    float y2[MODAL_LANES];
+    struct modal_string *order[SYMP_CORE_MAX_STRINGS];
+    int num_active;
+
+    /* the poles of the band-pass in the feedback path of the comb filters
+     * that the partials follow */
+    float low;
+    float high;
+
+    unsigned long sample_rate;
+};
+
+/* Sets up silent strings for the tunings in config, NULL removes all
+ * strings. Never allocates. The strings stay mute until
+ * symp_modal_set_coefs(). */
+void symp_modal_configure(struct symp_modal *modal, unsigned long sample_rate,
+        const struct symp_core_config *config);
+
+/* Recomputes the coefficients of all strings, not cheap: a few
+ * transcendental functions per partial. feedback and damping hold the
+ * values of each string, by string number. low and high are the poles of
+ * the high-pass and the low-pass in the feedback path, 1 and 0 for none. */
+void symp_modal_set_coefs(struct symp_modal *modal, const float *feedback,
+        const float *damping, float low, float high);
+
+void symp_modal_reset(struct symp_modal *modal);
+
+/* Makes all strings active again */
+void symp_modal_wake(struct symp_modal *modal);
+
+/* Puts every string to sleep whose state has decayed below threshold */
+void symp_modal_update_dormant(struct symp_modal *modal, float threshold);
+
+/* Runs the active strings over sample_count input samples, at most
+ * MODAL_CHUNK, and writes the sum of their outputs. With meter set, the
+ * peak and the sum of squares of each string's output are accumulated in its
+ * peak and sumsq. */
+void symp_modal_process(struct symp_modal *modal, const float *input, float *output,
+        unsigned long sample_count, int meter);
+
+#endif
@@ -3,8 +3,24 @@
  * This plugins tries to emulate a maximum of 11 sympathetic strings using
  * tuned comb filters with a high feedback amount. Result is a sort of metallic
  * sounding reverb. Each of the 11 "strings" can be tuned to an arbitrary
- * frequency to which it will respond the most. Combine with a band-pass filter
- * to get rid of any unwanted frequencies that might lead to ringing effects.
+ * frequency to which it will respond the most. The built-in band-pass (the
+ * Band-pass ports) gets rid of any unwanted frequencies that might lead to
+ * ringing effects, on the input, inside the feedback path of the strings or
+ * both.
+ *
+ * The comb filters live in the core library (symp_core.c), this file maps
+ * the LADSPA ports onto it. Output control ports report the DSP load as a
+ * fraction of the block duration, the number of active and dormant strings,
+ * whether the plugin is idle and the peak and RMS level of each string. The
+ * string levels are only collected while at least one of their ports is
+ * connected. The Decimation port runs the strings at a half or a quarter of
+ * the sample rate, the Engine port switches from the combs to the modal
+ * string model (see symp_core_set_engine()). Both are only read on
+ * activation, like the tunings. The Decay Mode port selects between the
+ * global Feedback and Damping, the per string Feedback and Damping ports,
+ * and an equal decay time for all strings, the Decay Time port. Freeze
+ * holds the strings as they are, Cheap Tail lets them ring out as loops
+ * once the input is silent (see symp_core_params).
  *
  * Author: Marcus Weseloh <marcus@weseloh.cc>
  */
@@ -12,14 +28,30 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
 
 #include <ladspa.h>
 
-#define COMB_COUNT (11)
+#include "symp_core.h"
+#include "probes.h"
+#include "trace.h"
+
+#ifdef SYMP_CAPTURE
+#include <unistd.h>
+#include "capture.h"
+
+#define CAPTURE_DEFAULT_RING_KB (4096)
+#endif
+
+#ifdef SYMP_TELEMETRY
+#include <unistd.h>
+#include "telemetry.h"
+
+#define TELEMETRY_DEFAULT_ENTRIES (1024)
+#endif
 
-#define FEEDBACK_OFFSET (0.96f)
-#define FEEDBACK_RANGE (0.039f)
-#define DAMPING_RANGE (0.5f)
+#define COMB_COUNT (SYMP_CORE_MAX_STRINGS)
 
 #define PORT_FEEDBACK (COMB_COUNT + 0)
 #define PORT_DAMPING (COMB_COUNT + 1)
@@ -32,14 +64,37 @@
 #define PORT_OUTPUT1 (COMB_COUNT + 6)
 #define PORT_OUTPUT2 (COMB_COUNT + 7)
 
-const LADSPA_Descriptor symp_descriptor;
+#define PORT_LOAD_AVG (COMB_COUNT + 8)
+#define PORT_LOAD_PEAK (COMB_COUNT + 9)
+#define PORT_ACTIVE_COMBS (COMB_COUNT + 10)
+#define PORT_DORMANT_COMBS (COMB_COUNT + 11)
+#define PORT_IDLE (COMB_COUNT + 12)
 
-struct comb {
-  float store;
-  float *buffer;
-  int size;
-  int idx;
-};
+#define PORT_STRING_PEAK (COMB_COUNT + 13)
+#define PORT_STRING_RMS (COMB_COUNT * 2 + 13)
+
+#define PORT_DECIMATION (COMB_COUNT * 3 + 13)
+#define PORT_ENGINE (COMB_COUNT * 3 + 14)
+
+#define PORT_BANDPASS_LOW (COMB_COUNT * 3 + 15)
+#define PORT_BANDPASS_HIGH (COMB_COUNT * 3 + 16)
+#define PORT_BANDPASS_MODE (COMB_COUNT * 3 + 17)
+
+#define PORT_DECAY_MODE (COMB_COUNT * 3 + 18)
+#define PORT_DECAY_TIME (COMB_COUNT * 3 + 19)
+#define PORT_STRING_FEEDBACK (COMB_COUNT * 3 + 20)
+#define PORT_STRING_DAMPING (COMB_COUNT * 4 + 20)
+
+#define PORT_FREEZE (COMB_COUNT * 5 + 20)
+#define PORT_TAIL (COMB_COUNT * 5 + 21)
+
+#define PORT_COUNT (COMB_COUNT * 5 + 22)
+
+/* time constants of the DSP load meter, in seconds */
+#define LOAD_AVG_TIME (1.0f)
+#define LOAD_PEAK_TIME (2.0f)
+
+const LADSPA_Descriptor symp_descriptor;
 
 struct symp
 {
@@ -56,53 +111,123 @@ struct symp
     LADSPA_Data *audio_output1;
     LADSPA_Data *audio_output2;
 
-    struct comb *combs[COMB_COUNT];
-    int num_combs;
+    LADSPA_Data *ctrl_load_avg;
+    LADSPA_Data *ctrl_load_peak;
+    LADSPA_Data *ctrl_active_combs;
+    LADSPA_Data *ctrl_dormant_combs;
+    LADSPA_Data *ctrl_idle;
+
+    LADSPA_Data *ctrl_string_peak[COMB_COUNT];
+    LADSPA_Data *ctrl_string_rms[COMB_COUNT];
+    int num_meter_ports;
+
+    LADSPA_Data *ctrl_decimation;
+    LADSPA_Data *ctrl_engine;
+
+    LADSPA_Data *ctrl_bandpass_low;
+    LADSPA_Data *ctrl_bandpass_high;
+    LADSPA_Data *ctrl_bandpass_mode;
+
+    LADSPA_Data *ctrl_decay_mode;
+    LADSPA_Data *ctrl_decay_time;
+    LADSPA_Data *ctrl_string_feedback[COMB_COUNT];
+    LADSPA_Data *ctrl_string_damping[COMB_COUNT];
 
-    float damping;
-    float damp1;
-    float damp2;
+    LADSPA_Data *ctrl_freeze;
+    LADSPA_Data *ctrl_tail;
 
-    float feedback;
-    float scaled_feedback;
+    struct symp_core *core;
+    struct symp_core_stats stats;
+
+    float load_avg;
+    float load_peak;
 
     unsigned long sample_rate;
+
+#ifdef SYMP_CAPTURE
+    struct capture *capture;
+#endif
+
+#ifdef SYMP_TELEMETRY
+    struct telemetry *telemetry;
+#endif
 };
 
-int symp_setup_combs(struct symp *symp)
+#ifdef SYMP_TELEMETRY
+/* Publishes per-block statistics in the shared memory segment
+ * /$SYMP_TELEMETRY.<pid>.<instance> if the environment variable is set.
+ * $SYMP_TELEMETRY_ENTRIES sets the number of entries in the ring. */
+void symp_telemetry_open(struct symp *symp)
 {
-    int i;
-    int size;
-    struct comb *comb;
+    static int instance_count;
+    const char *prefix = getenv("SYMP_TELEMETRY");
+    const char *entries = getenv("SYMP_TELEMETRY_ENTRIES");
+    char name[256];
 
-    for (i = 0; i < COMB_COUNT; i++) {
-        if (*symp->ctrl_tunings[i] <= 0) continue;
-
-        size = symp->sample_rate / *symp->ctrl_tunings[i];
-        comb = malloc(sizeof(struct comb));
-        if (comb == NULL) return -1;
-        symp->combs[symp->num_combs++] = comb;
-        memset(comb, 0, sizeof(struct comb));
-
-        comb->buffer = malloc(size * sizeof(float));
-        if (comb->buffer == NULL) return -1;
-        memset(comb->buffer, 0, size * sizeof(float));
-        comb->size = size;
+    if (prefix == NULL || *prefix == '\0') return;
+
+    snprintf(name, sizeof(name), "/%s.%d.%d", prefix, (int)getpid(),
+            __atomic_fetch_add(&instance_count, 1, __ATOMIC_RELAXED));
+
+    symp->telemetry = telemetry_open(name, symp->sample_rate, COMB_COUNT,
+            entries ? strtoul(entries, NULL, 10) : TELEMETRY_DEFAULT_ENTRIES);
+    if (symp->telemetry == NULL) {
+        printf("Unable to create telemetry segment %s\n", name);
     }
+}
+#endif
 
-    return 1;
+#ifdef SYMP_CAPTURE
+/* Starts recording to $SYMP_CAPTURE.<pid>.<instance> if the environment
+ * variable is set. $SYMP_CAPTURE_KB sets the size of the ring buffer. */
+void symp_capture_open(struct symp *symp)
+{
+    static int instance_count;
+    const char *prefix = getenv("SYMP_CAPTURE");
+    const char *ring_kb = getenv("SYMP_CAPTURE_KB");
+    unsigned long ring_size;
+    char path[1024];
+
+    if (prefix == NULL || *prefix == '\0') return;
+
+    ring_size = (ring_kb ? strtoul(ring_kb, NULL, 10) : CAPTURE_DEFAULT_RING_KB) * 1024;
+    snprintf(path, sizeof(path), "%s.%d.%d", prefix, (int)getpid(),
+            __atomic_fetch_add(&instance_count, 1, __ATOMIC_RELAXED));
+
+    symp->capture = capture_open(path, symp->sample_rate, PORT_COUNT, ring_size);
+    if (symp->capture == NULL) {
+        printf("Unable to capture to %s\n", path);
+    }
 }
 
-void symp_cleanup_combs(struct symp *symp)
+/* Fills controls[port] with the value of every input control port, the
+ * audio and output ports are recorded as 0 */
+void symp_capture_controls(struct symp *symp, float *controls)
 {
     int i;
 
-    for (i = 0; i < symp->num_combs; i++) {
-        free(symp->combs[i]);
-        symp->combs[i] = NULL;
+    memset(controls, 0, PORT_COUNT * sizeof(float));
+    for (i = 0; i < COMB_COUNT; i++) {
+        controls[i] = *symp->ctrl_tunings[i];
+        controls[PORT_STRING_FEEDBACK + i] = *symp->ctrl_string_feedback[i];
+        controls[PORT_STRING_DAMPING + i] = *symp->ctrl_string_damping[i];
     }
-    symp->num_combs = 0;
+    controls[PORT_FEEDBACK] = *symp->ctrl_feedback;
+    controls[PORT_DAMPING] = *symp->ctrl_damping;
+    controls[PORT_GAIN_INPUT] = *symp->ctrl_gain_input;
+    controls[PORT_WET_LEFT] = *symp->ctrl_wet_left;
+    controls[PORT_WET_RIGHT] = *symp->ctrl_wet_right;
+    controls[PORT_DECIMATION] = *symp->ctrl_decimation;
+    controls[PORT_ENGINE] = *symp->ctrl_engine;
+    controls[PORT_BANDPASS_LOW] = *symp->ctrl_bandpass_low;
+    controls[PORT_BANDPASS_HIGH] = *symp->ctrl_bandpass_high;
+    controls[PORT_BANDPASS_MODE] = *symp->ctrl_bandpass_mode;
+    controls[PORT_DECAY_MODE] = *symp->ctrl_decay_mode;
+    controls[PORT_DECAY_TIME] = *symp->ctrl_decay_time;
+    controls[PORT_FREEZE] = *symp->ctrl_freeze;
+    controls[PORT_TAIL] = *symp->ctrl_tail;
 }
+#endif
 
 LADSPA_Handle symp_instantiate(const LADSPA_Descriptor *desc, unsigned long sample_rate)
 {
@@ -113,40 +238,110 @@ LADSPA_Handle symp_instantiate(const LADSPA_Descriptor *desc, unsigned long samp
     memset(symp, 0, sizeof(struct symp));
 
     symp->sample_rate = sample_rate;
-    symp->damp2 = 0;
-    symp->damp2 = 1;
+    symp->core = symp_core_create(sample_rate);
+    if (symp->core == NULL) {
+        free(symp);
+        return NULL;
+    }
+
+#ifdef SYMP_CAPTURE
+    symp_capture_open(symp);
+#endif
+
+#ifdef SYMP_TELEMETRY
+    symp_telemetry_open(symp);
+#endif
 
     return symp;
 }
 
 void symp_cleanup(LADSPA_Handle handle)
 {
-    free(handle);
+    struct symp *symp = (struct symp *)handle;
+
+#ifdef SYMP_CAPTURE
+    capture_close(symp->capture);
+#endif
+#ifdef SYMP_TELEMETRY
+    telemetry_close(symp->telemetry);
+#endif
+    symp_core_destroy(symp->core);
+    free(symp);
+}
+
+/* Rounds the Decimation port value to a supported factor */
+static int symp_decimation(LADSPA_Data value)
+{
+    if (value >= 3) return 4;
+    if (value >= 1.5) return 2;
+    return 1;
 }
 
 void symp_activate(LADSPA_Handle handle)
 {
     struct symp *symp = (struct symp *)handle;
+    struct symp_core_config config;
+    int i;
+
+    SYMP_PROBE1(activate_start, symp->sample_rate);
 
-    if (!symp_setup_combs(symp)) {
+    for (i = 0; i < COMB_COUNT; i++) {
+        config.tunings[i] = *symp->ctrl_tunings[i];
+    }
+    /* like the tunings, only read on activation */
+    symp_core_set_decimation(symp->core, symp_decimation(*symp->ctrl_decimation));
+    symp_core_set_engine(symp->core, *symp->ctrl_engine >= 0.5f
+            ? SYMP_CORE_ENGINE_MODAL : SYMP_CORE_ENGINE_COMB);
+    if (symp_core_configure(symp->core, &config) < 0) {
         printf("Out of memory!\n");
     }
+
+#ifdef SYMP_CAPTURE
+    if (symp->capture) {
+        float controls[PORT_COUNT];
+        symp_capture_controls(symp, controls);
+        capture_activate(symp->capture, controls);
+    }
+#endif
+
+    SYMP_PROBE1(activate_end, symp_core_num_active(symp->core));
 }
 
 void symp_deactivate(LADSPA_Handle handle)
 {
     struct symp *symp = (struct symp *)handle;
-    symp_cleanup_combs(symp);
+    symp_core_configure(symp->core, NULL);
 }
 
 void symp_connect_port(LADSPA_Handle handle, unsigned long port, LADSPA_Data *buf)
 {
     struct symp *symp = (struct symp *)handle;
+    int i;
 
     /* string tunings */
     if (port < COMB_COUNT) {
         symp->ctrl_tunings[port] = buf;
     }
+    /* string level meters */
+    else if (port >= PORT_STRING_PEAK && port < PORT_DECIMATION) {
+        if (port < PORT_STRING_RMS)
+            symp->ctrl_string_peak[port - PORT_STRING_PEAK] = buf;
+        else
+            symp->ctrl_string_rms[port - PORT_STRING_RMS] = buf;
+
+        symp->num_meter_ports = 0;
+        for (i = 0; i < COMB_COUNT; i++) {
+            symp->num_meter_ports += (symp->ctrl_string_peak[i] != NULL)
+                + (symp->ctrl_string_rms[i] != NULL);
+        }
+    }
+    /* per string feedback and damping */
+    else if (port >= PORT_STRING_FEEDBACK && port < PORT_STRING_DAMPING + COMB_COUNT) {
+        if (port < PORT_STRING_DAMPING)
+            symp->ctrl_string_feedback[port - PORT_STRING_FEEDBACK] = buf;
+        else
+            symp->ctrl_string_damping[port - PORT_STRING_DAMPING] = buf;
+    }
     else {
         switch (port) {
             case PORT_FEEDBACK:
@@ -173,71 +368,217 @@ void symp_connect_port(LADSPA_Handle handle, unsigned long port, LADSPA_Data *bu
             case PORT_OUTPUT2:
                 symp->audio_output2 = buf;
                 break;
+            case PORT_LOAD_AVG:
+                symp->ctrl_load_avg = buf;
+                break;
+            case PORT_LOAD_PEAK:
+                symp->ctrl_load_peak = buf;
+                break;
+            case PORT_ACTIVE_COMBS:
+                symp->ctrl_active_combs = buf;
+                break;
+            case PORT_DORMANT_COMBS:
+                symp->ctrl_dormant_combs = buf;
+                break;
+            case PORT_IDLE:
+                symp->ctrl_idle = buf;
+                break;
+            case PORT_DECIMATION:
+                symp->ctrl_decimation = buf;
+                break;
+            case PORT_ENGINE:
+                symp->ctrl_engine = buf;
+                break;
+            case PORT_BANDPASS_LOW:
+                symp->ctrl_bandpass_low = buf;
+                break;
+            case PORT_BANDPASS_HIGH:
+                symp->ctrl_bandpass_high = buf;
+                break;
+            case PORT_BANDPASS_MODE:
+                symp->ctrl_bandpass_mode = buf;
+                break;
+            case PORT_DECAY_MODE:
+                symp->ctrl_decay_mode = buf;
+                break;
+            case PORT_DECAY_TIME:
+                symp->ctrl_decay_time = buf;
+                break;
+            case PORT_FREEZE:
+                symp->ctrl_freeze = buf;
+                break;
+            case PORT_TAIL:
+                symp->ctrl_tail = buf;
+                break;
         }
     }
 }
 
-void inline symp_run_effect(LADSPA_Handle handle, unsigned long sample_count, int add)
+static inline unsigned long long symp_now_ns(void)
 {
-    struct symp *symp = (struct symp *)handle;
-    LADSPA_Data *audio_input = symp->audio_input;
-    LADSPA_Data *out1 = symp->audio_output1;
-    LADSPA_Data *out2 = symp->audio_output2;
-    LADSPA_Data adding_gain = symp->run_adding_gain;
-    LADSPA_Data input_gain = *symp->ctrl_gain_input;
-    LADSPA_Data wet_left = *symp->ctrl_wet_left;
-    LADSPA_Data wet_right = *symp->ctrl_wet_right;
-    int i, c;
-    struct comb *comb;
-    float in, out, tmp, feedback;
-
-    if (wet_left < 0) wet_left = 0;
-    else if (wet_left > 1.0) wet_left = 1.0;
-
-    if (wet_right < 0) wet_right = 0;
-    else if (wet_right > 1.0) wet_right = 1.0;
-
-    if (*symp->ctrl_damping != symp->damping) {
-        symp->damping = *symp->ctrl_damping;
-        symp->damp1 = symp->damping * DAMPING_RANGE;
-        symp->damp2 = 1 - symp->damp1;
-    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Publishes the telemetry output ports, once per block */
+void symp_update_telemetry(struct symp *symp, unsigned long sample_count,
+        unsigned long long run_ns)
+{
+    struct symp_core_stats *stats = &symp->stats;
+    float load, coeff;
+
+    if ((symp->ctrl_load_avg || symp->ctrl_load_peak) && sample_count > 0) {
+        load = run_ns * 1e-9f * symp->sample_rate / sample_count;
+
+        coeff = (float)sample_count / (symp->sample_rate * LOAD_AVG_TIME);
+        if (coeff > 1.0f) coeff = 1.0f;
+        symp->load_avg += (load - symp->load_avg) * coeff;
+
+        coeff = 1.0f - (float)sample_count / (symp->sample_rate * LOAD_PEAK_TIME);
+        if (coeff < 0.0f) coeff = 0.0f;
+        symp->load_peak *= coeff;
+        if (load > symp->load_peak) symp->load_peak = load;
 
-    if (*symp->ctrl_feedback != symp->feedback) {
-        symp->feedback = *symp->ctrl_feedback;
-        symp->scaled_feedback = FEEDBACK_OFFSET + (symp->feedback * FEEDBACK_RANGE);
+        if (symp->ctrl_load_avg) *symp->ctrl_load_avg = symp->load_avg;
+        if (symp->ctrl_load_peak) *symp->ctrl_load_peak = symp->load_peak;
     }
 
-    feedback = symp->scaled_feedback;
+    if (symp->ctrl_active_combs)
+        *symp->ctrl_active_combs = stats->num_active;
+    if (symp->ctrl_dormant_combs)
+        *symp->ctrl_dormant_combs = stats->num_strings - stats->num_active;
+    if (symp->ctrl_idle)
+        *symp->ctrl_idle = stats->num_active == 0;
+}
 
-    for (i = 0; i < sample_count; i++) {
-        out = 0.0f;
-        in = *audio_input * input_gain;
+/* Publishes the string level meters, once per block */
+void symp_update_meters(struct symp *symp)
+{
+    int i;
 
-        for (c = 0; c < symp->num_combs; c++) {
-            comb = symp->combs[c];
+    for (i = 0; i < COMB_COUNT; i++) {
+        if (symp->ctrl_string_peak[i]) *symp->ctrl_string_peak[i] = symp->stats.peak[i];
+        if (symp->ctrl_string_rms[i]) *symp->ctrl_string_rms[i] = symp->stats.rms[i];
+    }
+}
 
-            tmp = comb->buffer[comb->idx];
-            comb->store = (tmp * symp->damp2) + (comb->store * symp->damp1);
-            comb->buffer[comb->idx] = in + (comb->store * feedback);
-            if (++comb->idx >= comb->size) {
-                comb->idx = 0;
-            }
-            out += tmp;
-        }
+#ifdef SYMP_TELEMETRY
+/* A handful of stores into the shared-memory ring, once per block */
+void symp_publish_telemetry(struct symp *symp, unsigned long sample_count,
+        unsigned long long start_ns, unsigned long long run_ns)
+{
+    struct telemetry_entry *entry = telemetry_begin(symp->telemetry);
 
-        if (add) {
-            if (wet_left > 0)
-                *(out1++) += out * adding_gain * wet_left;
-            if (wet_right > 0)
-                *(out2++) += out * adding_gain * wet_right;
-        } else {
-            *(out1++) = out * wet_left;
-            *(out2++) = out * wet_right;
-        }
+    entry->sample_count = sample_count;
+    entry->time_ns = start_ns;
+    entry->run_ns = run_ns;
+    entry->active_combs = symp->stats.num_active;
+    entry->num_combs = symp->stats.num_strings;
+    memset(entry->peaks, 0, sizeof(entry->peaks));
+    memcpy(entry->peaks, symp->stats.peak, sizeof(symp->stats.peak));
 
-        audio_input++;
+    telemetry_commit(symp->telemetry, entry);
+}
+#endif
+
+static inline void symp_run_effect(LADSPA_Handle handle, unsigned long sample_count, int add)
+{
+    struct symp *symp = (struct symp *)handle;
+    struct symp_core_params params;
+    int meter = 0, i;
+    unsigned long long start_ns = 0, run_ns = 0;
+
+    TRACE_BEGIN(symp_core_trace(symp->core));
+    TRACE_PHASE(symp_core_trace(symp->core), "parameters");
+
+    meter = symp->num_meter_ports > 0;
+#ifdef SYMP_TELEMETRY
+    meter = meter || symp->telemetry != NULL;
+#endif
+    symp_core_set_metering(symp->core, meter);
+
+    if (symp->ctrl_load_avg || symp->ctrl_load_peak)
+        start_ns = symp_now_ns();
+#ifdef SYMP_TELEMETRY
+    if (symp->telemetry)
+        start_ns = symp_now_ns();
+#endif
+
+#ifdef SYMP_CAPTURE
+    if (symp->capture) {
+        float controls[PORT_COUNT];
+        symp_capture_controls(symp, controls);
+        capture_block(symp->capture, controls, symp->audio_input, sample_count, add,
+                symp->run_adding_gain);
+    }
+#endif
+
+    params.feedback = *symp->ctrl_feedback;
+    params.damping = *symp->ctrl_damping;
+    params.input_gain = *symp->ctrl_gain_input;
+    params.wet_left = *symp->ctrl_wet_left;
+    params.wet_right = *symp->ctrl_wet_right;
+    params.bandpass_low = *symp->ctrl_bandpass_low;
+    params.bandpass_high = *symp->ctrl_bandpass_high;
+    params.bandpass = lrintf(*symp->ctrl_bandpass_mode)
+        & (SYMP_CORE_BANDPASS_INPUT | SYMP_CORE_BANDPASS_FEEDBACK);
+    params.decay = lrintf(*symp->ctrl_decay_mode);
+    params.rt60 = *symp->ctrl_decay_time;
+    for (i = 0; i < COMB_COUNT; i++) {
+        params.string_feedback[i] = *symp->ctrl_string_feedback[i];
+        params.string_damping[i] = *symp->ctrl_string_damping[i];
     }
+    params.freeze = *symp->ctrl_freeze > 0.0f;
+    params.tail = *symp->ctrl_tail > 0.0f;
+    symp_core_set_params(symp->core, &params);
+
+    if (add)
+        symp_core_process_adding(symp->core, symp->audio_input, symp->audio_output1,
+                symp->audio_output2, sample_count, symp->run_adding_gain);
+    else
+        symp_core_process(symp->core, symp->audio_input, symp->audio_output1,
+                symp->audio_output2, sample_count);
+
+    TRACE_PHASE(symp_core_trace(symp->core), "telemetry");
+
+    if (start_ns)
+        run_ns = symp_now_ns() - start_ns;
+
+    symp_core_get_stats(symp->core, &symp->stats);
+    symp_update_telemetry(symp, sample_count, run_ns);
+    if (symp->num_meter_ports)
+        symp_update_meters(symp);
+
+#ifdef SYMP_TELEMETRY
+    if (symp->telemetry)
+        symp_publish_telemetry(symp, sample_count, start_ns, run_ns);
+#endif
+
+    TRACE_END(symp_core_trace(symp->core));
+}
+
+#ifdef SYMP_TRACE
+const struct symp_trace *symp_trace_last_block(LADSPA_Handle handle)
+{
+    struct symp *symp = (struct symp *)handle;
+    return symp_core_trace(symp->core);
+}
+#endif
+
+long symp_snapshot(LADSPA_Handle handle, void *buf, size_t size)
+{
+    struct symp *symp = (struct symp *)handle;
+
+    if (buf == NULL)
+        return symp_core_snapshot_size(symp->core);
+    return symp_core_snapshot(symp->core, buf, size);
+}
+
+int symp_restore(LADSPA_Handle handle, const void *buf, size_t size)
+{
+    struct symp *symp = (struct symp *)handle;
+    return symp_core_restore(symp->core, buf, size);
 }
 
 void symp_set_run_adding_gain(LADSPA_Handle handle, LADSPA_Data gain)
@@ -246,14 +587,24 @@ void symp_set_run_adding_gain(LADSPA_Handle handle, LADSPA_Data gain)
     symp->run_adding_gain = gain;
 }
 
+/* for the probes, only evaluated while a tracer is attached to them */
+static inline int symp_num_active(LADSPA_Handle handle)
+{
+    return symp_core_num_active(((struct symp *)handle)->core);
+}
+
 void symp_run(LADSPA_Handle handle, unsigned long sample_count)
 {
+    SYMP_PROBE2(run_start, sample_count, symp_num_active(handle));
     symp_run_effect(handle, sample_count, 0);
+    SYMP_PROBE2(run_end, sample_count, symp_num_active(handle));
 }
 
 void symp_run_adding(LADSPA_Handle handle, unsigned long sample_count)
 {
+    SYMP_PROBE2(run_adding_start, sample_count, symp_num_active(handle));
     symp_run_effect(handle, sample_count, 1);
+    SYMP_PROBE2(run_adding_end, sample_count, symp_num_active(handle));
 }
 
 const LADSPA_Descriptor *ladspa_descriptor(unsigned long idx)
@@ -275,7 +626,7 @@ const LADSPA_Descriptor symp_descriptor = {
 
     .Properties = LADSPA_PROPERTY_HARD_RT_CAPABLE,
 
-    .PortCount = COMB_COUNT + 5 + 3,
+    .PortCount = PORT_COUNT,
 
     .PortDescriptors = (LADSPA_PortDescriptor[]) {
         /* tuning controls (ports 0-11) */
@@ -299,7 +650,83 @@ const LADSPA_Descriptor symp_descriptor = {
 
         LADSPA_PORT_INPUT | LADSPA_PORT_AUDIO,
         LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
-        LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_AUDIO,
+
+        /* telemetry */
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+
+        /* string peak levels */
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+
+        /* string RMS levels */
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_OUTPUT | LADSPA_PORT_CONTROL,
+
+        /* decimation and engine */
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+
+        /* band-pass */
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+
+        /* decay mode and time */
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+
+        /* string feedback */
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+
+        /* string damping */
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+
+        /* freeze and tail */
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL,
+        LADSPA_PORT_INPUT | LADSPA_PORT_CONTROL
     },
 
     .PortNames = (const char *[]) {
@@ -323,7 +750,74 @@ const LADSPA_Descriptor symp_descriptor = {
 
         "Input Mono",
         "Output Left",
-        "Output Right"
+        "Output Right",
+
+        "DSP Load Average",
+        "DSP Load Peak",
+        "Active Strings",
+        "Dormant Strings",
+        "Idle",
+
+        "String1 Peak",
+        "String2 Peak",
+        "String3 Peak",
+        "String4 Peak",
+        "String5 Peak",
+        "String6 Peak",
+        "String7 Peak",
+        "String8 Peak",
+        "String9 Peak",
+        "String10 Peak",
+        "String11 Peak",
+
+        "String1 RMS",
+        "String2 RMS",
+        "String3 RMS",
+        "String4 RMS",
+        "String5 RMS",
+        "String6 RMS",
+        "String7 RMS",
+        "String8 RMS",
+        "String9 RMS",
+        "String10 RMS",
+        "String11 RMS",
+
+        "Decimation",
+        "Engine",
+
+        "Band-pass Low",
+        "Band-pass High",
+        "Band-pass Mode",
+
+        "Decay Mode",
+        "Decay Time",
+
+        "String1 Feedback",
+        "String2 Feedback",
+        "String3 Feedback",
+        "String4 Feedback",
+        "String5 Feedback",
+        "String6 Feedback",
+        "String7 Feedback",
+        "String8 Feedback",
+        "String9 Feedback",
+        "String10 Feedback",
+        "String11 Feedback",
+
+        "String1 Damping",
+        "String2 Damping",
+        "String3 Damping",
+        "String4 Damping",
+        "String5 Damping",
+        "String6 Damping",
+        "String7 Damping",
+        "String8 Damping",
+        "String9 Damping",
+        "String10 Damping",
+        "String11 Damping",
+
+        "Freeze",
+        "Cheap Tail"
     },
 
     .PortRangeHints = (LADSPA_PortRangeHint[]) {
@@ -355,6 +849,85 @@ const LADSPA_Descriptor symp_descriptor = {
         {0}, 
         {0}, 
         {0}, 
+
+        /* DSP Load Average and Peak, fraction of the block duration */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE, .LowerBound = 0.0, .UpperBound = 1.0},
+        /* Active and Dormant Strings */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_INTEGER, .LowerBound = 0, .UpperBound = COMB_COUNT},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_INTEGER, .LowerBound = 0, .UpperBound = COMB_COUNT},
+        /* Idle */
+        {.HintDescriptor = LADSPA_HINT_TOGGLED},
+
+        /* String Peak levels */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        /* String RMS levels */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW, .LowerBound = 0.0},
+
+        /* Decimation, 1, 2 or 4 */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_INTEGER | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 1, .UpperBound = 4},
+        /* Engine, 0 for the combs, 1 for the modal strings */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_INTEGER | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0, .UpperBound = 1},
+
+        /* Band-pass Low and High, the cutoffs in Hz, 0 for none */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_100, .LowerBound = 0, .UpperBound = 1000},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MAXIMUM, .LowerBound = 0, .UpperBound = 20000},
+        /* Band-pass Mode, 0 for off, 1 on the input, 2 in the feedback path, 3 for both */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_INTEGER | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0, .UpperBound = 3},
+
+        /* Decay Mode, 0 for Feedback and Damping, 1 for the string ports, 2 for the Decay Time */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_INTEGER | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0, .UpperBound = 2},
+        /* Decay Time, 60 dB in seconds */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_LOW, .LowerBound = 0.0, .UpperBound = 20.0},
+
+        /* String Feedback */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MIDDLE, .LowerBound = 0.0, .UpperBound = 1.0},
+        /* String Damping */
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+        {.HintDescriptor = LADSPA_HINT_BOUNDED_BELOW | LADSPA_HINT_BOUNDED_ABOVE | LADSPA_HINT_DEFAULT_MINIMUM, .LowerBound = 0.0, .UpperBound = 1.0},
+
+        /* Freeze and Cheap Tail */
+        {.HintDescriptor = LADSPA_HINT_TOGGLED | LADSPA_HINT_DEFAULT_0},
+        {.HintDescriptor = LADSPA_HINT_TOGGLED | LADSPA_HINT_DEFAULT_0},
     },
 
     .instantiate = symp_instantiate,
@@ -0,0 +1,95 @@
+/* Shared-memory telemetry ring for external monitoring
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+struct telemetry {
+    char name[256];
+    struct telemetry_header *header;
+    struct telemetry_entry *entries;
+    size_t size;
+    uint64_t write_count;
+};
+
+struct telemetry *telemetry_open(const char *name, unsigned long sample_rate,
+        int num_strings, unsigned long capacity)
+{
+    struct telemetry *tel;
+    int fd;
+
+    if (num_strings > TELEMETRY_MAX_COMBS || capacity < 1) return NULL;
+
+    tel = malloc(sizeof(struct telemetry));
+    if (tel == NULL) return NULL;
+    memset(tel, 0, sizeof(struct telemetry));
+
+    strncpy(tel->name, name, sizeof(tel->name) - 1);
+    tel->size = sizeof(struct telemetry_header) + capacity * sizeof(struct telemetry_entry);
+
+    fd = shm_open(tel->name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0) goto error;
+    if (ftruncate(fd, tel->size) < 0) {
+        close(fd);
+        shm_unlink(tel->name);
+        goto error;
+    }
+
+    tel->header = mmap(NULL, tel->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (tel->header == MAP_FAILED) {
+        shm_unlink(tel->name);
+        goto error;
+    }
+
+    /* touch all pages now so the audio thread doesn't take the page faults */
+    memset(tel->header, 0, tel->size);
+    tel->entries = (struct telemetry_entry *)(tel->header + 1);
+
+    tel->header->version = TELEMETRY_VERSION;
+    tel->header->capacity = capacity;
+    tel->header->entry_size = sizeof(struct telemetry_entry);
+    tel->header->sample_rate = sample_rate;
+    tel->header->num_strings = num_strings;
+    __atomic_store_n(&tel->header->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+
+    return tel;
+
+error:
+    free(tel);
+    return NULL;
+}
+
+void telemetry_close(struct telemetry *tel)
+{
+    if (tel == NULL) return;
+
+    munmap(tel->header, tel->size);
+    shm_unlink(tel->name);
+    free(tel);
+}
+
+struct telemetry_entry *telemetry_begin(struct telemetry *tel)
+{
+    struct telemetry_entry *entry;
+
+    entry = &tel->entries[tel->write_count % tel->header->capacity];
+    __atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    entry->block = tel->write_count;
+    return entry;
+}
+
+void telemetry_commit(struct telemetry *tel, struct telemetry_entry *entry)
+{
+    __atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&tel->header->write_count, ++tel->write_count, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,53 @@
+/* Shared-memory telemetry ring for external monitoring
+ *
+ * Each instance can publish per-block statistics into a POSIX shared memory
+ * segment. The segment starts with a telemetry_header followed by capacity
+ * telemetry_entry slots used as a ring. Every slot is protected by its own
+ * sequence counter: it is odd while the audio thread writes the slot, so a
+ * reader copies the slot and only uses the copy if the counter was even and
+ * unchanged before and after copying.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_TELEMETRY_H
+#define SYMP_TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC (0x544d5953) /* "SYMT" */
+#define TELEMETRY_VERSION (1)
+#define TELEMETRY_MAX_COMBS (16)
+
+struct telemetry_entry {
+    uint32_t seq;
+    uint32_t sample_count;
+    uint64_t block;
+    uint64_t time_ns;       /* CLOCK_MONOTONIC at the start of the block */
+    uint32_t run_ns;
+    uint16_t active_combs;
+    uint16_t num_combs;
+    float peaks[TELEMETRY_MAX_COMBS];   /* per string, by string number */
+};
+
+struct telemetry_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t entry_size;
+    uint32_t sample_rate;
+    uint32_t num_strings;
+    uint64_t write_count;   /* number of entries written so far */
+};
+
+struct telemetry;
+
+struct telemetry *telemetry_open(const char *name, unsigned long sample_rate,
+        int num_strings, unsigned long capacity);
+void telemetry_close(struct telemetry *tel);
+
+/* Returns the next slot to fill in; must be followed by telemetry_commit() */
+struct telemetry_entry *telemetry_begin(struct telemetry *tel);
+void telemetry_commit(struct telemetry *tel, struct telemetry_entry *entry);
+
+#endif
@@ -0,0 +1,60 @@
+/* Per-block phase tracing
+ *
+ * A plugin built with TRACE=1 timestamps the phases of every block and
+ * exports symp_trace_last_block(), which returns the phases of the most
+ * recent run() or run_adding() call of an instance. The benchmark looks the
+ * function up and writes the phases into its Chrome trace output.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_TRACE_H
+#define SYMP_TRACE_H
+
+#define SYMP_TRACE_SYMBOL "symp_trace_last_block"
+#define SYMP_TRACE_MAX_PHASES (8)
+
+struct symp_trace {
+    const char *kernel;
+    int num_phases;
+    const char *names[SYMP_TRACE_MAX_PHASES];
+    unsigned long long start_ns[SYMP_TRACE_MAX_PHASES];
+    unsigned long long end_ns[SYMP_TRACE_MAX_PHASES];
+};
+
+typedef const struct symp_trace *(*symp_trace_function)(void *handle);
+
+#ifdef SYMP_TRACE
+#include <time.h>
+
+#define TRACE_BEGIN(tr) ((tr)->num_phases = 0, (tr)->kernel = "none")
+#define TRACE_PHASE(tr, name) symp_trace_phase(tr, name)
+#define TRACE_KERNEL(tr, name) ((tr)->kernel = (name))
+#define TRACE_END(tr) symp_trace_phase(tr, NULL)
+
+/* Ends the current phase, if any, and starts the next one */
+static inline void symp_trace_phase(struct symp_trace *tr, const char *name)
+{
+    struct timespec ts;
+    unsigned long long now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    if (tr->num_phases > 0)
+        tr->end_ns[tr->num_phases - 1] = now;
+    if (name && tr->num_phases < SYMP_TRACE_MAX_PHASES) {
+        tr->names[tr->num_phases] = name;
+        tr->start_ns[tr->num_phases] = now;
+        tr->end_ns[tr->num_phases] = now;
+        tr->num_phases++;
+    }
+}
+#else
+#define TRACE_BEGIN(tr) do {} while (0)
+#define TRACE_PHASE(tr, name) do {} while (0)
+#define TRACE_KERNEL(tr, name) do {} while (0)
+#define TRACE_END(tr) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/* Writer for the Chrome trace event format
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <string.h>
+
+#include "chrome-trace.h"
+
+static void next_event(struct chrome_trace *trace)
+{
+    fputs(trace->events++ ? ",\n" : "\n", trace->file);
+}
+
+static double to_us(const struct chrome_trace *trace, unsigned long long ns)
+{
+    return (double)(long long)(ns - trace->origin_ns) / 1000.0;
+}
+
+int chrome_trace_open(struct chrome_trace *trace, const char *path,
+        unsigned long long origin_ns)
+{
+    memset(trace, 0, sizeof(struct chrome_trace));
+
+    trace->file = fopen(path, "w");
+    if (trace->file == NULL) return -1;
+
+    trace->origin_ns = origin_ns;
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", trace->file);
+    return 0;
+}
+
+void chrome_trace_close(struct chrome_trace *trace)
+{
+    if (trace->file == NULL) return;
+
+    fputs("\n]}\n", trace->file);
+    fclose(trace->file);
+    trace->file = NULL;
+}
+
+void chrome_trace_process_name(struct chrome_trace *trace, int pid, const char *name)
+{
+    next_event(trace);
+    fprintf(trace->file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", pid, name);
+}
+
+void chrome_trace_thread_name(struct chrome_trace *trace, int pid, int tid, const char *name)
+{
+    next_event(trace);
+    fprintf(trace->file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", pid, tid, name);
+}
+
+void chrome_trace_complete(struct chrome_trace *trace, int pid, int tid, const char *name,
+        unsigned long long start_ns, unsigned long long dur_ns, const char *args)
+{
+    next_event(trace);
+    fprintf(trace->file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{%s}}",
+            name, pid, tid, to_us(trace, start_ns), dur_ns / 1000.0, args ? args : "");
+}
+
+void chrome_trace_counter(struct chrome_trace *trace, int pid, const char *name,
+        unsigned long long ts_ns, const char *series, double value)
+{
+    next_event(trace);
+    fprintf(trace->file, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"ts\":%.3f,"
+            "\"args\":{\"%s\":%g}}", name, pid, to_us(trace, ts_ns), series, value);
+}
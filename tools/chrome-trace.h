@@ -0,0 +1,33 @@
+/* Writer for the Chrome trace event format
+ *
+ * The resulting JSON file can be opened in chrome://tracing or
+ * https://ui.perfetto.dev.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_TOOLS_CHROME_TRACE_H
+#define SYMP_TOOLS_CHROME_TRACE_H
+
+#include <stdio.h>
+
+struct chrome_trace {
+    FILE *file;
+    unsigned long long origin_ns;
+    unsigned long events;
+};
+
+int chrome_trace_open(struct chrome_trace *trace, const char *path,
+        unsigned long long origin_ns);
+void chrome_trace_close(struct chrome_trace *trace);
+
+void chrome_trace_process_name(struct chrome_trace *trace, int pid, const char *name);
+void chrome_trace_thread_name(struct chrome_trace *trace, int pid, int tid, const char *name);
+
+/* complete event, args is a JSON object body without braces, or NULL */
+void chrome_trace_complete(struct chrome_trace *trace, int pid, int tid, const char *name,
+        unsigned long long start_ns, unsigned long long dur_ns, const char *args);
+void chrome_trace_counter(struct chrome_trace *trace, int pid, const char *name,
+        unsigned long long ts_ns, const char *series, double value);
+
+#endif
@@ -0,0 +1,253 @@
+/* Minimal LADSPA host used by the benchmark and test tools
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+/* melody notes of the test signal, roughly a G/C gurdy tune */
+static const float signal_notes[] = {
+    392.0f, 440.0f, 493.9f, 523.3f, 587.3f, 523.3f, 493.9f, 440.0f
+};
+#define SIGNAL_NOTE_COUNT (sizeof(signal_notes) / sizeof(signal_notes[0]))
+
+int host_load(struct host_plugin *plugin, const char *path, unsigned long index)
+{
+    LADSPA_Descriptor_Function fn;
+
+    memset(plugin, 0, sizeof(struct host_plugin));
+
+    plugin->lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (plugin->lib == NULL) {
+        fprintf(stderr, "Unable to load %s: %s\n", path, dlerror());
+        return -1;
+    }
+
+    fn = (LADSPA_Descriptor_Function)dlsym(plugin->lib, "ladspa_descriptor");
+    if (fn == NULL) {
+        fprintf(stderr, "%s is not a LADSPA plugin\n", path);
+        dlclose(plugin->lib);
+        return -1;
+    }
+
+    plugin->desc = fn(index);
+    if (plugin->desc == NULL) {
+        fprintf(stderr, "%s has no plugin with index %lu\n", path, index);
+        dlclose(plugin->lib);
+        return -1;
+    }
+
+    return 0;
+}
+
+void host_unload(struct host_plugin *plugin)
+{
+    if (plugin->lib)
+        dlclose(plugin->lib);
+    memset(plugin, 0, sizeof(struct host_plugin));
+}
+
+int host_find_port(const LADSPA_Descriptor *desc, const char *name)
+{
+    unsigned long i;
+
+    for (i = 0; i < desc->PortCount; i++) {
+        if (strcmp(desc->PortNames[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+LADSPA_Data host_port_default(const LADSPA_Descriptor *desc, unsigned long port,
+        unsigned long sample_rate)
+{
+    const LADSPA_PortRangeHint *hint = &desc->PortRangeHints[port];
+    LADSPA_PortRangeHintDescriptor hd = hint->HintDescriptor;
+    float lower = hint->LowerBound;
+    float upper = hint->UpperBound;
+    int log = LADSPA_IS_HINT_LOGARITHMIC(hd) && lower > 0 && upper > 0;
+
+    if (LADSPA_IS_HINT_SAMPLE_RATE(hd)) {
+        lower *= sample_rate;
+        upper *= sample_rate;
+    }
+
+    if (LADSPA_IS_HINT_DEFAULT_MINIMUM(hd))
+        return lower;
+    if (LADSPA_IS_HINT_DEFAULT_MAXIMUM(hd))
+        return upper;
+    if (LADSPA_IS_HINT_DEFAULT_LOW(hd))
+        return log ? expf(logf(lower) * 0.75f + logf(upper) * 0.25f)
+                   : lower * 0.75f + upper * 0.25f;
+    if (LADSPA_IS_HINT_DEFAULT_MIDDLE(hd))
+        return log ? expf(logf(lower) * 0.5f + logf(upper) * 0.5f)
+                   : lower * 0.5f + upper * 0.5f;
+    if (LADSPA_IS_HINT_DEFAULT_HIGH(hd))
+        return log ? expf(logf(lower) * 0.25f + logf(upper) * 0.75f)
+                   : lower * 0.25f + upper * 0.75f;
+    if (LADSPA_IS_HINT_DEFAULT_1(hd))
+        return 1;
+    if (LADSPA_IS_HINT_DEFAULT_100(hd))
+        return 100;
+    if (LADSPA_IS_HINT_DEFAULT_440(hd))
+        return 440;
+    return 0;
+}
+
+int host_instance_init(struct host_instance *inst, const struct host_plugin *plugin,
+        unsigned long sample_rate, unsigned long max_block)
+{
+    const LADSPA_Descriptor *desc = plugin->desc;
+    LADSPA_PortDescriptor pd;
+    unsigned long i;
+    int outputs = 0;
+
+    memset(inst, 0, sizeof(struct host_instance));
+    inst->desc = desc;
+    inst->sample_rate = sample_rate;
+    inst->max_block = max_block;
+
+    inst->controls = calloc(desc->PortCount, sizeof(LADSPA_Data));
+    inst->input = calloc(max_block, sizeof(LADSPA_Data));
+    inst->outputs[0] = calloc(max_block, sizeof(LADSPA_Data));
+    inst->outputs[1] = calloc(max_block, sizeof(LADSPA_Data));
+    if (!inst->controls || !inst->input || !inst->outputs[0] || !inst->outputs[1])
+        goto error;
+
+    inst->handle = desc->instantiate(desc, sample_rate);
+    if (inst->handle == NULL)
+        goto error;
+
+    for (i = 0; i < desc->PortCount; i++) {
+        pd = desc->PortDescriptors[i];
+        if (LADSPA_IS_PORT_CONTROL(pd)) {
+            if (LADSPA_IS_PORT_INPUT(pd))
+                inst->controls[i] = host_port_default(desc, i, sample_rate);
+            desc->connect_port(inst->handle, i, &inst->controls[i]);
+        }
+        else if (LADSPA_IS_PORT_INPUT(pd)) {
+            desc->connect_port(inst->handle, i, inst->input);
+        }
+        else {
+            desc->connect_port(inst->handle, i, inst->outputs[outputs > 0]);
+            outputs++;
+        }
+    }
+
+    if (desc->set_run_adding_gain)
+        desc->set_run_adding_gain(inst->handle, 1.0f);
+
+    return 0;
+
+error:
+    host_instance_free(inst);
+    return -1;
+}
+
+void host_instance_free(struct host_instance *inst)
+{
+    if (inst->handle) {
+        host_deactivate(inst);
+        inst->desc->cleanup(inst->handle);
+    }
+    free(inst->controls);
+    free(inst->input);
+    free(inst->outputs[0]);
+    free(inst->outputs[1]);
+    memset(inst, 0, sizeof(struct host_instance));
+}
+
+int host_set_control(struct host_instance *inst, const char *name, LADSPA_Data value)
+{
+    int port = host_find_port(inst->desc, name);
+
+    if (port < 0)
+        return -1;
+    inst->controls[port] = value;
+    return 0;
+}
+
+/* Connects an optional output port to NULL, for plugins that allow it */
+int host_disconnect_port(struct host_instance *inst, const char *name)
+{
+    int port = host_find_port(inst->desc, name);
+
+    if (port < 0)
+        return -1;
+    inst->desc->connect_port(inst->handle, port, NULL);
+    return 0;
+}
+
+void host_activate(struct host_instance *inst)
+{
+    if (!inst->active && inst->desc->activate)
+        inst->desc->activate(inst->handle);
+    inst->active = 1;
+}
+
+void host_deactivate(struct host_instance *inst)
+{
+    if (inst->active && inst->desc->deactivate)
+        inst->desc->deactivate(inst->handle);
+    inst->active = 0;
+}
+
+void host_run(struct host_instance *inst, unsigned long sample_count, int add)
+{
+    add = add && inst->desc->run_adding;
+
+    if (rtcheck_enter)
+        rtcheck_enter(add ? "run_adding" : "run");
+
+    if (add)
+        inst->desc->run_adding(inst->handle, sample_count);
+    else
+        inst->desc->run(inst->handle, sample_count);
+
+    if (rtcheck_leave)
+        rtcheck_leave();
+}
+
+void host_signal_init(struct host_signal *sig, unsigned long sample_rate)
+{
+    memset(sig, 0, sizeof(struct host_signal));
+    sig->noise = 0x12345678;
+    sig->note_len = sample_rate / 4;
+    sig->freq = signal_notes[0];
+}
+
+/* Sawtooth melody with slight vibrato and bow noise. Each note is followed
+ * by a short gap so the resonator also sees decaying tails. */
+void host_signal_fill(struct host_signal *sig, LADSPA_Data *buf, unsigned long count,
+        unsigned long sample_rate)
+{
+    unsigned long i;
+    float noise, freq, gate;
+
+    for (i = 0; i < count; i++) {
+        if (++sig->pos >= sig->note_len) {
+            sig->pos = 0;
+            sig->note = (sig->note + 1) % SIGNAL_NOTE_COUNT;
+            sig->freq = signal_notes[sig->note];
+        }
+        gate = (sig->pos < sig->note_len * 7 / 8) ? 1.0f : 0.0f;
+
+        sig->vib_phase += 5.5f / sample_rate;
+        if (sig->vib_phase >= 1.0f) sig->vib_phase -= 1.0f;
+        freq = sig->freq * (1.0f + 0.004f * sinf(2 * M_PI * sig->vib_phase));
+
+        sig->phase += freq / sample_rate;
+        if (sig->phase >= 1.0f) sig->phase -= 1.0f;
+
+        sig->noise = sig->noise * 1664525u + 1013904223u;
+        noise = (float)(sig->noise >> 8) / (float)(1 << 24) - 0.5f;
+
+        buf[i] = gate * (0.5f * (2.0f * sig->phase - 1.0f) + 0.02f * noise);
+    }
+}
@@ -0,0 +1,80 @@
+/* Minimal LADSPA host used by the benchmark and test tools
+ *
+ * Loads a plugin library, instantiates it with all ports connected to
+ * host-owned buffers and runs it block by block, the way a real host would.
+ * Control inputs start at the defaults given by the port range hints.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#ifndef SYMP_TOOLS_HOST_H
+#define SYMP_TOOLS_HOST_H
+
+#include <time.h>
+
+#include <ladspa.h>
+
+#define HOST_DEFAULT_PLUGIN "build/sympathetic.so"
+
+struct host_plugin {
+    void *lib;
+    const LADSPA_Descriptor *desc;
+};
+
+struct host_instance {
+    const LADSPA_Descriptor *desc;
+    LADSPA_Handle handle;
+    unsigned long sample_rate;
+    unsigned long max_block;
+    int active;
+
+    /* one value per port, control inputs and outputs are connected here */
+    LADSPA_Data *controls;
+
+    LADSPA_Data *input;
+    LADSPA_Data *outputs[2];
+};
+
+/* deterministic signal source resembling a bowed melody string */
+struct host_signal {
+    float phase;
+    float freq;
+    float vib_phase;
+    unsigned int noise;
+    unsigned long pos;
+    unsigned long note_len;
+    int note;
+};
+
+int host_load(struct host_plugin *plugin, const char *path, unsigned long index);
+void host_unload(struct host_plugin *plugin);
+
+int host_find_port(const LADSPA_Descriptor *desc, const char *name);
+LADSPA_Data host_port_default(const LADSPA_Descriptor *desc, unsigned long port,
+        unsigned long sample_rate);
+
+int host_instance_init(struct host_instance *inst, const struct host_plugin *plugin,
+        unsigned long sample_rate, unsigned long max_block);
+void host_instance_free(struct host_instance *inst);
+int host_set_control(struct host_instance *inst, const char *name, LADSPA_Data value);
+int host_disconnect_port(struct host_instance *inst, const char *name);
+void host_activate(struct host_instance *inst);
+void host_deactivate(struct host_instance *inst);
+void host_run(struct host_instance *inst, unsigned long sample_count, int add);
+
+void host_signal_init(struct host_signal *sig, unsigned long sample_rate);
+void host_signal_fill(struct host_signal *sig, LADSPA_Data *buf, unsigned long count,
+        unsigned long sample_rate);
+
+/* provided by the rtcheck preload library, if loaded */
+extern void rtcheck_enter(const char *context) __attribute__((weak));
+extern void rtcheck_leave(void) __attribute__((weak));
+
+static inline unsigned long long host_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
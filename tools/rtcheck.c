@@ -0,0 +1,369 @@
+/* Real-time safety checker
+ *
+ * Preload library that interposes memory allocation, locking and file I/O
+ * functions. The tool host marks the plugin's run() and run_adding() calls
+ * with rtcheck_enter() and rtcheck_leave(); any interposed call made in
+ * between is reported with its call stack. If there were any violations, the
+ * process exit status is forced to RTCHECK_EXIT_STATUS.
+ *
+ * Usage: LD_PRELOAD=build/rtcheck.so build/symp-bench ...
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RTCHECK_EXIT_STATUS (3)
+#define RTCHECK_MAX_REPORTS (10)
+#define RTCHECK_MAX_FRAMES (32)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread int rt_depth;
+static __thread int in_report;
+static __thread const char *rt_context;
+
+static unsigned long violations;
+static unsigned long rt_calls;
+
+void rtcheck_enter(const char *context)
+{
+    rt_context = context;
+    rt_depth++;
+    __atomic_add_fetch(&rt_calls, 1, __ATOMIC_RELAXED);
+}
+
+void rtcheck_leave(void)
+{
+    rt_depth--;
+}
+
+static void put(const char *str)
+{
+    ssize_t ret = write(STDERR_FILENO, str, strlen(str));
+    (void)ret;
+}
+
+static void violation(const char *func)
+{
+    void *frames[RTCHECK_MAX_FRAMES];
+    unsigned long count;
+    int n;
+
+    if (rt_depth <= 0 || in_report)
+        return;
+
+    in_report = 1;
+    count = __atomic_add_fetch(&violations, 1, __ATOMIC_RELAXED);
+    if (count <= RTCHECK_MAX_REPORTS) {
+        put("rtcheck: ");
+        put(func);
+        put("() called from ");
+        put(rt_context ? rt_context : "real-time context");
+        put("()\n");
+        n = backtrace(frames, RTCHECK_MAX_FRAMES);
+        backtrace_symbols_fd(frames, n, STDERR_FILENO);
+    }
+    in_report = 0;
+}
+
+#define REAL(ret, name, args) \
+    static ret (*real_##name) args; \
+    if (real_##name == NULL) \
+        real_##name = (ret (*) args)dlsym(RTLD_NEXT, #name)
+
+__attribute__((constructor))
+static void rtcheck_init(void)
+{
+    void *frames[2];
+
+    /* the first backtrace() loads libgcc, get that out of the way */
+    backtrace(frames, 2);
+}
+
+__attribute__((destructor))
+static void rtcheck_fini(void)
+{
+    char msg[128];
+
+    snprintf(msg, sizeof(msg), "rtcheck: %lu violations in %lu real-time calls\n",
+            violations, rt_calls);
+    put(msg);
+    if (violations)
+        _exit(RTCHECK_EXIT_STATUS);
+}
+
+/* memory */
+
+void *malloc(size_t size)
+{
+    violation("malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    violation("calloc");
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    violation("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    violation("free");
+    __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    violation("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    violation("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    violation("posix_memalign");
+    *memptr = __libc_memalign(alignment, size);
+    return *memptr ? 0 : 12;
+}
+
+/* locking */
+
+int pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+    REAL(int, pthread_mutex_lock, (pthread_mutex_t *));
+    violation("pthread_mutex_lock");
+    return real_pthread_mutex_lock(mutex);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex)
+{
+    REAL(int, pthread_mutex_trylock, (pthread_mutex_t *));
+    violation("pthread_mutex_trylock");
+    return real_pthread_mutex_trylock(mutex);
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+    REAL(int, pthread_mutex_unlock, (pthread_mutex_t *));
+    violation("pthread_mutex_unlock");
+    return real_pthread_mutex_unlock(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock)
+{
+    REAL(int, pthread_rwlock_rdlock, (pthread_rwlock_t *));
+    violation("pthread_rwlock_rdlock");
+    return real_pthread_rwlock_rdlock(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock)
+{
+    REAL(int, pthread_rwlock_wrlock, (pthread_rwlock_t *));
+    violation("pthread_rwlock_wrlock");
+    return real_pthread_rwlock_wrlock(lock);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+    REAL(int, pthread_cond_wait, (pthread_cond_t *, pthread_mutex_t *));
+    violation("pthread_cond_wait");
+    return real_pthread_cond_wait(cond, mutex);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond)
+{
+    REAL(int, pthread_cond_signal, (pthread_cond_t *));
+    violation("pthread_cond_signal");
+    return real_pthread_cond_signal(cond);
+}
+
+int sem_wait(sem_t *sem)
+{
+    REAL(int, sem_wait, (sem_t *));
+    violation("sem_wait");
+    return real_sem_wait(sem);
+}
+
+/* file I/O */
+
+FILE *fopen(const char *path, const char *mode)
+{
+    REAL(FILE *, fopen, (const char *, const char *));
+    violation("fopen");
+    return real_fopen(path, mode);
+}
+
+size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+    REAL(size_t, fwrite, (const void *, size_t, size_t, FILE *));
+    violation("fwrite");
+    return real_fwrite(ptr, size, nmemb, stream);
+}
+
+size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream)
+{
+    REAL(size_t, fread, (void *, size_t, size_t, FILE *));
+    violation("fread");
+    return real_fread(ptr, size, nmemb, stream);
+}
+
+int fputs(const char *str, FILE *stream)
+{
+    REAL(int, fputs, (const char *, FILE *));
+    violation("fputs");
+    return real_fputs(str, stream);
+}
+
+int puts(const char *str)
+{
+    REAL(int, puts, (const char *));
+    violation("puts");
+    return real_puts(str);
+}
+
+int putchar(int c)
+{
+    REAL(int, putchar, (int));
+    violation("putchar");
+    return real_putchar(c);
+}
+
+int fflush(FILE *stream)
+{
+    REAL(int, fflush, (FILE *));
+    violation("fflush");
+    return real_fflush(stream);
+}
+
+int vfprintf(FILE *stream, const char *fmt, va_list ap)
+{
+    REAL(int, vfprintf, (FILE *, const char *, va_list));
+    violation("vfprintf");
+    return real_vfprintf(stream, fmt, ap);
+}
+
+int vprintf(const char *fmt, va_list ap)
+{
+    REAL(int, vfprintf, (FILE *, const char *, va_list));
+    violation("vprintf");
+    return real_vfprintf(stdout, fmt, ap);
+}
+
+int fprintf(FILE *stream, const char *fmt, ...)
+{
+    REAL(int, vfprintf, (FILE *, const char *, va_list));
+    va_list ap;
+    int ret;
+
+    violation("fprintf");
+    va_start(ap, fmt);
+    ret = real_vfprintf(stream, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+int printf(const char *fmt, ...)
+{
+    REAL(int, vfprintf, (FILE *, const char *, va_list));
+    va_list ap;
+    int ret;
+
+    violation("printf");
+    va_start(ap, fmt);
+    ret = real_vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+int __printf_chk(int flag, const char *fmt, ...)
+{
+    REAL(int, vfprintf, (FILE *, const char *, va_list));
+    va_list ap;
+    int ret;
+
+    violation("printf");
+    va_start(ap, fmt);
+    ret = real_vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+int __fprintf_chk(FILE *stream, int flag, const char *fmt, ...)
+{
+    REAL(int, vfprintf, (FILE *, const char *, va_list));
+    va_list ap;
+    int ret;
+
+    violation("fprintf");
+    va_start(ap, fmt);
+    ret = real_vfprintf(stream, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+int open(const char *path, int flags, ...)
+{
+    REAL(int, open, (const char *, int, ...));
+    va_list ap;
+    int mode;
+
+    violation("open");
+    va_start(ap, flags);
+    mode = va_arg(ap, int);
+    va_end(ap);
+    return real_open(path, flags, mode);
+}
+
+int close(int fd)
+{
+    REAL(int, close, (int));
+    violation("close");
+    return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    REAL(ssize_t, read, (int, void *, size_t));
+    violation("read");
+    return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+    REAL(ssize_t, write, (int, const void *, size_t));
+    violation("write");
+    return real_write(fd, buf, count);
+}
+
+int usleep(useconds_t usec)
+{
+    REAL(int, usleep, (useconds_t));
+    violation("usleep");
+    return real_usleep(usec);
+}
@@ -0,0 +1,640 @@
+/* Benchmark for the sympathetic string plugin
+ *
+ * Runs 1 to N instances interleaved, block by block, the way a host would
+ * run several effects next to each other. Optionally a synthetic neighbour
+ * walks over a buffer of the given size between the instance runs to evict
+ * their comb buffers from the cache, similar to what the synth engine does
+ * on the real boards. Reports the per-instance cost for each instance count
+ * and how it degrades compared to a single instance.
+ *
+ * With -c, the same benchmark is also run against a second plugin build and
+ * the speedup of the plugin under test against it is reported, along with
+ * the difference between the outputs of the two builds on the same signal.
+ *
+ * With -R, replays a file recorded by a plugin built with CAPTURE=1 instead:
+ * the recorded activations, control values and input blocks are fed to a
+ * single instance in the original order and the slowest blocks are listed.
+ *
+ * With -W, only the first instance is warmed up, for the given time, and all
+ * instances start from a snapshot of its state. This needs a plugin that
+ * exports symp_snapshot() and symp_restore(), others are warmed up one by
+ * one as without -W.
+ *
+ * With -T, every timed block (up to TRACE_MAX_BLOCKS per instance count, all
+ * blocks of a replay) is written to a Chrome trace event file. If the plugin
+ * was built with TRACE=1, the trace includes the phases of each block and
+ * the kernel variant that processed it.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chrome-trace.h"
+#include "host.h"
+#include "../src/capture.h"
+#include "../src/symp_core.h"
+#include "../src/trace.h"
+
+#define CACHE_LINE (64)
+#define REPLAY_SLOWEST (10)
+#define TRACE_MAX_BLOCKS (2000)
+#define MAX_CONTROLS (16)
+
+struct bench_opts {
+    const char *plugin;
+    unsigned long index;
+    unsigned long sample_rate;
+    unsigned long block_size;
+    float seconds;
+    int max_instances;
+    unsigned long pollute_kb;
+    int add;
+    const char *replay;
+    int realtime;
+    const char *compare;
+    const char *trace;
+    int meters;
+    float warm_secs;
+
+    /* control port values given with -C */
+    const char *control_names[MAX_CONTROLS];
+    float control_values[MAX_CONTROLS];
+    int num_controls;
+};
+
+struct bench_result {
+    double ns_per_block;
+    double ns_max;
+};
+
+static unsigned char *polluter;
+static volatile unsigned long polluter_sink;
+
+static struct chrome_trace trace;
+static symp_trace_function trace_fn;
+
+static void trace_block(int pid, int tid, const struct host_instance *inst,
+        unsigned long long start, unsigned long long elapsed, unsigned long sample_count)
+{
+    const struct symp_trace *tr = trace_fn ? trace_fn(inst->handle) : NULL;
+    char args[128];
+    int p, port;
+
+    snprintf(args, sizeof(args), "\"samples\":%lu,\"kernel\":\"%s\"",
+            sample_count, tr ? tr->kernel : "unknown");
+    chrome_trace_complete(&trace, pid, tid, "run", start, elapsed, args);
+
+    for (p = 0; tr && p < tr->num_phases; p++) {
+        chrome_trace_complete(&trace, pid, tid, tr->names[p], tr->start_ns[p],
+                tr->end_ns[p] - tr->start_ns[p], NULL);
+    }
+
+    port = host_find_port(inst->desc, "Active Strings");
+    if (port >= 0 && tid == 0)
+        chrome_trace_counter(&trace, pid, "active strings", start, "strings",
+                inst->controls[port]);
+}
+
+/* Read-modify-write every cache line of the polluter buffer. */
+static void pollute(unsigned long size)
+{
+    unsigned long i, sum = 0;
+
+    for (i = 0; i < size; i += CACHE_LINE) {
+        polluter[i]++;
+        sum += polluter[i];
+    }
+    polluter_sink += sum;
+}
+
+/* The string level meters are only computed while connected */
+static void disconnect_meters(struct host_instance *inst)
+{
+    char name[32];
+    int i;
+
+    for (i = 1; i <= 11; i++) {
+        snprintf(name, sizeof(name), "String%d Peak", i);
+        host_disconnect_port(inst, name);
+        snprintf(name, sizeof(name), "String%d RMS", i);
+        host_disconnect_port(inst, name);
+    }
+}
+
+/* Sets the control ports given with -C, only done for the plugin under
+ * test, not for the base of a comparison */
+static int set_controls(const struct bench_opts *opts, struct host_instance *inst)
+{
+    int i;
+
+    for (i = 0; i < opts->num_controls; i++) {
+        if (host_set_control(inst, opts->control_names[i], opts->control_values[i])) {
+            fprintf(stderr, "No control port %s\n", opts->control_names[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Warms up the first instance and restores its state into all others.
+ * Returns -1 if the plugin does not support snapshots. */
+static int warm_from_snapshot(const struct bench_opts *opts, const struct host_plugin *plugin,
+        struct host_instance *insts, int count, struct host_signal *sig)
+{
+    symp_snapshot_function snapshot;
+    symp_restore_function restore;
+    unsigned long blocks, b;
+    void *buf;
+    long size;
+    int i, ret = 0;
+
+    snapshot = (symp_snapshot_function)dlsym(plugin->lib, SYMP_SNAPSHOT_SYMBOL);
+    restore = (symp_restore_function)dlsym(plugin->lib, SYMP_RESTORE_SYMBOL);
+    if (snapshot == NULL || restore == NULL) return -1;
+
+    blocks = opts->warm_secs * opts->sample_rate / opts->block_size + 1;
+    for (b = 0; b < blocks; b++) {
+        host_signal_fill(sig, insts[0].input, opts->block_size, opts->sample_rate);
+        host_run(&insts[0], opts->block_size, opts->add);
+    }
+
+    size = snapshot(insts[0].handle, NULL, 0);
+    buf = malloc(size);
+    if (buf == NULL || snapshot(insts[0].handle, buf, size) < 0) {
+        free(buf);
+        return -1;
+    }
+    for (i = 1; i < count; i++) {
+        if (restore(insts[i].handle, buf, size) < 0)
+            ret = -1;
+    }
+
+    free(buf);
+    return ret;
+}
+
+static int bench_instances(const struct bench_opts *opts, const struct host_plugin *plugin,
+        int count, int controls, struct bench_result *result)
+{
+    struct host_instance *insts;
+    struct host_signal sig;
+    unsigned long blocks, b;
+    unsigned long long start, elapsed, total = 0, max = 0;
+    int i, ret = 0;
+
+    insts = calloc(count, sizeof(struct host_instance));
+    if (insts == NULL) return -1;
+
+    for (i = 0; i < count; i++) {
+        if (host_instance_init(&insts[i], plugin, opts->sample_rate, opts->block_size)
+                || (controls && set_controls(opts, &insts[i]))) {
+            ret = -1;
+            goto out;
+        }
+        if (!opts->meters)
+            disconnect_meters(&insts[i]);
+        host_activate(&insts[i]);
+    }
+
+    host_signal_init(&sig, opts->sample_rate);
+    blocks = opts->seconds * opts->sample_rate / opts->block_size;
+    if (blocks < 1) blocks = 1;
+
+    if (trace.file) {
+        char name[32];
+        snprintf(name, sizeof(name), "%d instance%s", count, count > 1 ? "s" : "");
+        chrome_trace_process_name(&trace, count, name);
+    }
+
+    if (opts->warm_secs > 0 && warm_from_snapshot(opts, plugin, insts, count, &sig) == 0)
+        goto timed;
+
+    /* warm up, fills the comb buffers */
+    for (b = 0; b < blocks / 10 + 1; b++) {
+        host_signal_fill(&sig, insts[0].input, opts->block_size, opts->sample_rate);
+        for (i = 0; i < count; i++) {
+            if (i > 0)
+                memcpy(insts[i].input, insts[0].input, opts->block_size * sizeof(LADSPA_Data));
+            host_run(&insts[i], opts->block_size, opts->add);
+        }
+    }
+
+timed:
+    for (b = 0; b < blocks; b++) {
+        host_signal_fill(&sig, insts[0].input, opts->block_size, opts->sample_rate);
+        for (i = 0; i < count; i++) {
+            if (i > 0)
+                memcpy(insts[i].input, insts[0].input, opts->block_size * sizeof(LADSPA_Data));
+            if (opts->pollute_kb)
+                pollute(opts->pollute_kb * 1024);
+
+            start = host_now_ns();
+            host_run(&insts[i], opts->block_size, opts->add);
+            elapsed = host_now_ns() - start;
+
+            total += elapsed;
+            if (elapsed > max) max = elapsed;
+
+            if (trace.file && b < TRACE_MAX_BLOCKS)
+                trace_block(count, i, &insts[i], start, elapsed, opts->block_size);
+        }
+    }
+
+    result->ns_per_block = (double)total / (blocks * count);
+    result->ns_max = max;
+
+out:
+    for (i = 0; i < count; i++)
+        host_instance_free(&insts[i]);
+    free(insts);
+    return ret;
+}
+
+struct replay_block {
+    unsigned long index;
+    double offset;
+    unsigned long sample_count;
+    unsigned long long ns;
+};
+
+static void *read_file(const char *path, long *size)
+{
+    FILE *f = fopen(path, "rb");
+    void *data = NULL;
+
+    if (f == NULL) return NULL;
+    if (fseek(f, 0, SEEK_END) == 0 && (*size = ftell(f)) > 0) {
+        rewind(f);
+        data = malloc(*size);
+        if (data && fread(data, 1, *size, f) != *size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+static void sleep_until(unsigned long long ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int replay(const struct bench_opts *opts, const struct host_plugin *plugin)
+{
+    const struct capture_file_header *header;
+    const struct capture_record *rec;
+    const unsigned char *data, *pos, *end;
+    const float *controls;
+    struct host_instance inst;
+    struct replay_block slowest[REPLAY_SLOWEST], *slot;
+    unsigned long max_block = 1, blocks = 0, samples = 0, dropped = 0;
+    unsigned long long first_ns = 0, start_ns, block_ns, ns, total_ns = 0;
+    long size;
+    int i, s;
+
+    data = read_file(opts->replay, &size);
+    if (data == NULL || size < sizeof(*header)) {
+        fprintf(stderr, "Unable to read %s\n", opts->replay);
+        free((void *)data);
+        return -1;
+    }
+    header = (const struct capture_file_header *)data;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0
+            || header->version != CAPTURE_VERSION
+            || header->num_controls > plugin->desc->PortCount) {
+        fprintf(stderr, "%s is not a compatible capture file\n", opts->replay);
+        free((void *)data);
+        return -1;
+    }
+    end = data + size;
+
+    /* first pass: validate records and find the largest block */
+    for (pos = data + sizeof(*header); pos + sizeof(*rec) <= end; pos += rec->size) {
+        rec = (const struct capture_record *)pos;
+        if (rec->size < sizeof(*rec) || pos + rec->size > end) break;
+        if (rec->sample_count > max_block) max_block = rec->sample_count;
+    }
+    end = pos;
+
+    if (host_instance_init(&inst, plugin, header->sample_rate, max_block)) {
+        fprintf(stderr, "Unable to instantiate plugin\n");
+        free((void *)data);
+        return -1;
+    }
+
+    memset(slowest, 0, sizeof(slowest));
+    start_ns = host_now_ns();
+
+    if (trace.file)
+        chrome_trace_process_name(&trace, 0, "replay");
+
+    for (pos = data + sizeof(*header); pos < end; pos += rec->size) {
+        rec = (const struct capture_record *)pos;
+        controls = (const float *)(pos + sizeof(*rec));
+
+        if (first_ns == 0) first_ns = rec->time_ns;
+        dropped += rec->dropped;
+        for (i = 0; i < header->num_controls; i++) {
+            if (LADSPA_IS_PORT_CONTROL(inst.desc->PortDescriptors[i])
+                    && LADSPA_IS_PORT_INPUT(inst.desc->PortDescriptors[i]))
+                inst.controls[i] = controls[i];
+        }
+
+        if (rec->type == CAPTURE_ACTIVATE) {
+            host_deactivate(&inst);
+            host_activate(&inst);
+            continue;
+        }
+        if (rec->type != CAPTURE_BLOCK) continue;
+
+        host_activate(&inst);
+        memcpy(inst.input, controls + header->num_controls,
+                rec->sample_count * sizeof(LADSPA_Data));
+        if (rec->flags & CAPTURE_FLAG_ADDING && inst.desc->set_run_adding_gain)
+            inst.desc->set_run_adding_gain(inst.handle, rec->adding_gain);
+
+        if (opts->realtime)
+            sleep_until(start_ns + (rec->time_ns - first_ns));
+
+        block_ns = host_now_ns();
+        host_run(&inst, rec->sample_count, rec->flags & CAPTURE_FLAG_ADDING);
+        ns = host_now_ns() - block_ns;
+
+        if (trace.file)
+            trace_block(0, 0, &inst, block_ns, ns, rec->sample_count);
+
+        total_ns += ns;
+        samples += rec->sample_count;
+
+        /* keep the slowest blocks, sorted by descending time */
+        for (s = 0; s < REPLAY_SLOWEST && slowest[s].ns >= ns; s++);
+        if (s < REPLAY_SLOWEST) {
+            memmove(&slowest[s + 1], &slowest[s], (REPLAY_SLOWEST - s - 1) * sizeof(slowest[0]));
+            slot = &slowest[s];
+            slot->index = blocks;
+            slot->offset = (rec->time_ns - first_ns) / 1e9;
+            slot->sample_count = rec->sample_count;
+            slot->ns = ns;
+        }
+        blocks++;
+    }
+
+    printf("replay %s: %lu Hz, %lu blocks, %lu samples, %lu records dropped during capture\n",
+            opts->replay, (unsigned long)header->sample_rate, blocks, samples, dropped);
+    if (samples)
+        printf("%.2f ns/sample, %.1f%% average load\n", (double)total_ns / samples,
+                100.0 * total_ns * header->sample_rate / (1e9 * samples));
+
+    printf("%9s %10s %8s %12s %8s\n", "block", "time [s]", "samples", "ns", "load");
+    for (s = 0; s < REPLAY_SLOWEST && slowest[s].ns; s++) {
+        printf("%9lu %10.3f %8lu %12llu %7.1f%%\n", slowest[s].index, slowest[s].offset,
+                slowest[s].sample_count, slowest[s].ns,
+                100.0 * slowest[s].ns * header->sample_rate / (1e9 * slowest[s].sample_count));
+    }
+
+    host_instance_free(&inst);
+    free((void *)data);
+    return 0;
+}
+
+/* Runs one instance of each build on the same signal and reports how far
+ * the output of the plugin under test is from the base output */
+static int output_error(const struct bench_opts *opts, const struct host_plugin *plugin,
+        const struct host_plugin *base_plugin)
+{
+    struct host_instance inst, base;
+    struct host_signal sig;
+    unsigned long blocks, b, i;
+    double signal = 0, noise = 0, diff, max = 0;
+    int c, ret = 0;
+
+    memset(&inst, 0, sizeof(inst));
+    memset(&base, 0, sizeof(base));
+    if (host_instance_init(&inst, plugin, opts->sample_rate, opts->block_size)
+            || host_instance_init(&base, base_plugin, opts->sample_rate, opts->block_size)
+            || set_controls(opts, &inst)) {
+        ret = -1;
+        goto out;
+    }
+    host_activate(&inst);
+    host_activate(&base);
+
+    host_signal_init(&sig, opts->sample_rate);
+    blocks = opts->seconds * opts->sample_rate / opts->block_size;
+
+    for (b = 0; b < blocks; b++) {
+        host_signal_fill(&sig, base.input, opts->block_size, opts->sample_rate);
+        memcpy(inst.input, base.input, opts->block_size * sizeof(LADSPA_Data));
+        host_run(&base, opts->block_size, 0);
+        host_run(&inst, opts->block_size, 0);
+
+        for (c = 0; c < 2; c++) {
+            for (i = 0; i < opts->block_size; i++) {
+                diff = inst.outputs[c][i] - base.outputs[c][i];
+                signal += (double)base.outputs[c][i] * base.outputs[c][i];
+                noise += diff * diff;
+                if (fabs(diff) > max) max = fabs(diff);
+            }
+        }
+    }
+
+    if (noise > 0)
+        printf("output error: max %.3g, SNR %.1f dB\n", max, 10 * log10(signal / noise));
+    else
+        printf("output error: none, bit-identical output\n");
+
+out:
+    host_instance_free(&inst);
+    host_instance_free(&base);
+    return ret;
+}
+
+static int compare(const struct bench_opts *opts, const struct host_plugin *plugin)
+{
+    struct host_plugin base_plugin;
+    struct bench_result result, base;
+    int n;
+
+    if (host_load(&base_plugin, opts->compare, opts->index))
+        return -1;
+
+    printf("plugin %s against %s, %lu Hz, block %lu, neighbour %lu KiB\n",
+            opts->plugin, opts->compare, opts->sample_rate, opts->block_size,
+            opts->pollute_kb);
+    if (output_error(opts, plugin, &base_plugin)) {
+        fprintf(stderr, "Unable to compare the output\n");
+        host_unload(&base_plugin);
+        return -1;
+    }
+    printf("%9s %14s %14s %9s\n", "instances", "base ns/block", "ns/block", "speedup");
+
+    for (n = 1; n <= opts->max_instances; n++) {
+        if (bench_instances(opts, &base_plugin, n, 0, &base)
+                || bench_instances(opts, plugin, n, 1, &result)) {
+            fprintf(stderr, "Unable to run %d instances\n", n);
+            host_unload(&base_plugin);
+            return -1;
+        }
+        printf("%9d %14.0f %14.0f %8.3fx\n", n, base.ns_per_block, result.ns_per_block,
+                base.ns_per_block / result.ns_per_block);
+    }
+
+    host_unload(&base_plugin);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -p PATH   plugin library (default %s)\n"
+            "  -i INDEX  plugin index in the library (default 0)\n"
+            "  -n COUNT  maximum number of instances (default 8)\n"
+            "  -b SIZE   block size in samples (default 128)\n"
+            "  -r RATE   sample rate (default 44100)\n"
+            "  -s SECS   seconds of audio per instance count (default 10)\n"
+            "  -P KB     size of the cache polluting neighbour in KiB (default 0, off)\n"
+            "  -a        use run_adding instead of run\n"
+            "  -m        connect the string level meter ports\n"
+            "  -c PATH   compare against another build of the plugin\n"
+            "  -R FILE   replay a capture file instead of running the benchmark\n"
+            "  -x        replay with the recorded block timing\n"
+            "  -T FILE   write a Chrome trace of the timed blocks\n"
+            "  -W SECS   warm up one instance for SECS and start all from its snapshot\n"
+            "  -C NAME=VALUE  set a control port of the plugin under test, repeatable\n",
+            name, HOST_DEFAULT_PLUGIN);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_opts opts = {
+        .plugin = HOST_DEFAULT_PLUGIN,
+        .sample_rate = 44100,
+        .block_size = 128,
+        .seconds = 10,
+        .max_instances = 8,
+    };
+    struct host_plugin plugin;
+    struct bench_result result, base;
+    double budget, load;
+    char *value;
+    int opt, n, sustainable = 0;
+
+    while ((opt = getopt(argc, argv, "p:i:n:b:r:s:P:amc:R:xT:W:C:h")) != -1) {
+        switch (opt) {
+            case 'p': opts.plugin = optarg; break;
+            case 'i': opts.index = strtoul(optarg, NULL, 10); break;
+            case 'n': opts.max_instances = atoi(optarg); break;
+            case 'b': opts.block_size = strtoul(optarg, NULL, 10); break;
+            case 'r': opts.sample_rate = strtoul(optarg, NULL, 10); break;
+            case 's': opts.seconds = atof(optarg); break;
+            case 'P': opts.pollute_kb = strtoul(optarg, NULL, 10); break;
+            case 'a': opts.add = 1; break;
+            case 'm': opts.meters = 1; break;
+            case 'c': opts.compare = optarg; break;
+            case 'R': opts.replay = optarg; break;
+            case 'x': opts.realtime = 1; break;
+            case 'T': opts.trace = optarg; break;
+            case 'W': opts.warm_secs = atof(optarg); break;
+            case 'C':
+                value = strchr(optarg, '=');
+                if (value == NULL || opts.num_controls >= MAX_CONTROLS) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                *value = '\0';
+                opts.control_names[opts.num_controls] = optarg;
+                opts.control_values[opts.num_controls++] = atof(value + 1);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.max_instances < 1 || opts.block_size < 1 || opts.sample_rate < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (opts.pollute_kb) {
+        polluter = calloc(opts.pollute_kb, 1024);
+        if (polluter == NULL) {
+            fprintf(stderr, "Out of memory!\n");
+            return 1;
+        }
+    }
+
+    if (host_load(&plugin, opts.plugin, opts.index))
+        return 1;
+
+    if (opts.trace) {
+        if (chrome_trace_open(&trace, opts.trace, host_now_ns())) {
+            fprintf(stderr, "Unable to write %s\n", opts.trace);
+            host_unload(&plugin);
+            return 1;
+        }
+        trace_fn = (symp_trace_function)dlsym(plugin.lib, SYMP_TRACE_SYMBOL);
+    }
+
+    if (opts.replay) {
+        n = replay(&opts, &plugin);
+        chrome_trace_close(&trace);
+        host_unload(&plugin);
+        return n ? 1 : 0;
+    }
+
+    if (opts.compare) {
+        n = compare(&opts, &plugin);
+        chrome_trace_close(&trace);
+        host_unload(&plugin);
+        free(polluter);
+        return n ? 1 : 0;
+    }
+
+    budget = 1e9 * opts.block_size / opts.sample_rate;
+
+    printf("plugin %s (%s), %lu Hz, block %lu (%.1f us), neighbour %lu KiB\n",
+            plugin.desc->Label, opts.plugin, opts.sample_rate, opts.block_size,
+            budget / 1000, opts.pollute_kb);
+    printf("%9s %12s %12s %10s %10s %12s\n",
+            "instances", "ns/block", "max ns", "ns/sample", "vs. 1", "total load");
+
+    for (n = 1; n <= opts.max_instances; n++) {
+        if (bench_instances(&opts, &plugin, n, 1, &result)) {
+            fprintf(stderr, "Unable to run %d instances\n", n);
+            chrome_trace_close(&trace);
+            host_unload(&plugin);
+            return 1;
+        }
+        if (n == 1) base = result;
+
+        load = n * result.ns_per_block / budget;
+        if (load < 1.0) sustainable = n;
+
+        printf("%9d %12.0f %12.0f %10.2f %9.2fx %11.1f%%\n",
+                n, result.ns_per_block, result.ns_max,
+                result.ns_per_block / opts.block_size,
+                result.ns_per_block / base.ns_per_block, load * 100);
+    }
+
+    /* extrapolate from the most loaded measurement */
+    printf("sustainable instances: %d measured, ~%d estimated at the %d-instance cost\n",
+            sustainable, (int)(budget / result.ns_per_block), opts.max_instances);
+
+    chrome_trace_close(&trace);
+    host_unload(&plugin);
+    free(polluter);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/* Reader for the shared-memory telemetry of the sympathetic string plugin
+ *
+ * Maps the telemetry segment of a plugin instance built with TELEMETRY=1 and
+ * polls it, printing one line per interval with the DSP load, the number of
+ * active strings and the per-string peak levels of the newest blocks.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/telemetry.h"
+
+/* Copies a ring slot, returns 0 if the copy is consistent */
+static int read_entry(const struct telemetry_entry *slot, struct telemetry_entry *entry)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if (seq & 1) return -1;
+    memcpy(entry, (const void *)slot, sizeof(*entry));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) return -1;
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] NAME\n"
+            "  NAME      shared memory segment, e.g. /symp.1234.0\n"
+            "  -i MSECS  poll interval (default 500)\n"
+            "  -c COUNT  stop after COUNT intervals (default 0, run forever)\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const struct telemetry_header *header;
+    const struct telemetry_entry *entries;
+    struct telemetry_entry entry;
+    struct timespec interval = { 0, 500 * 1000000L };
+    struct stat st;
+    uint64_t last = 0, count, i, blocks, samples, run_ns, max_ns;
+    float peaks[TELEMETRY_MAX_COMBS];
+    int opt, fd, s, polls = 0, max_polls = 0, active = 0, num_combs = 0;
+    long ms;
+
+    while ((opt = getopt(argc, argv, "i:c:h")) != -1) {
+        switch (opt) {
+            case 'i':
+                ms = atol(optarg);
+                interval.tv_sec = ms / 1000;
+                interval.tv_nsec = (ms % 1000) * 1000000L;
+                break;
+            case 'c': max_polls = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    fd = shm_open(argv[optind], O_RDONLY, 0);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < sizeof(*header)) {
+        fprintf(stderr, "Unable to open %s\n", argv[optind]);
+        return 1;
+    }
+    header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        fprintf(stderr, "Unable to map %s\n", argv[optind]);
+        return 1;
+    }
+
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC
+            || header->version != TELEMETRY_VERSION
+            || header->entry_size != sizeof(struct telemetry_entry)
+            || st.st_size < sizeof(*header) + (uint64_t)header->capacity * header->entry_size) {
+        fprintf(stderr, "%s is not a compatible telemetry segment\n", argv[optind]);
+        return 1;
+    }
+    entries = (const struct telemetry_entry *)(header + 1);
+
+    printf("%s: %u Hz, %u entries\n", argv[optind], header->sample_rate, header->capacity);
+    printf("%8s %8s %8s %7s %7s  %s\n", "blocks", "avg us", "max us", "load", "strings",
+            "peak dBFS per string");
+
+    while (max_polls == 0 || polls++ < max_polls) {
+        nanosleep(&interval, NULL);
+
+        count = __atomic_load_n(&header->write_count, __ATOMIC_ACQUIRE);
+        if (count - last > header->capacity)
+            last = count - header->capacity;
+
+        blocks = samples = run_ns = max_ns = 0;
+        memset(peaks, 0, sizeof(peaks));
+        for (i = last; i < count; i++) {
+            if (read_entry(&entries[i % header->capacity], &entry) || entry.block != i)
+                continue;
+            blocks++;
+            samples += entry.sample_count;
+            run_ns += entry.run_ns;
+            if (entry.run_ns > max_ns) max_ns = entry.run_ns;
+            active = entry.active_combs;
+            num_combs = entry.num_combs;
+            for (s = 0; s < header->num_strings && s < TELEMETRY_MAX_COMBS; s++)
+                if (entry.peaks[s] > peaks[s]) peaks[s] = entry.peaks[s];
+        }
+        last = count;
+
+        if (blocks == 0) {
+            printf("%8d\n", 0);
+            continue;
+        }
+
+        printf("%8llu %8.1f %8.1f %6.1f%% %3d/%-3d ", (unsigned long long)blocks,
+                run_ns / 1000.0 / blocks, max_ns / 1000.0,
+                samples ? 100.0 * run_ns * header->sample_rate / (1e9 * samples) : 0,
+                active, num_combs);
+        for (s = 0; s < header->num_strings && s < TELEMETRY_MAX_COMBS; s++) {
+            if (peaks[s] > 0)
+                printf(" %4.0f", 20 * log10f(peaks[s]));
+            else
+                printf("    -");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,391 @@
+/* Worst-case execution time and jitter test for the sympathetic string plugin
+ *
+ * Drives run() and run_adding() through a seeded random sequence of segments,
+ * each with its own tunings, controls, input kind and block sizes: extreme
+ * tunings, feedback at 1.0, silence after loud input to get long decaying
+ * tails, odd block sizes and random control changes between blocks. Every
+ * block is timed and its output checked for NaN and Inf.
+ *
+ * Prints a histogram of the block run times and a summary per input kind.
+ * Exits with a non-zero status if any block exceeded the budget or produced
+ * non-finite output.
+ *
+ * Author: Marcus Weseloh <marcus@weseloh.cc>
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+#define HIST_BUCKETS (24)
+#define MAX_REPORTS (20)
+
+enum input_kind {
+    INPUT_SIGNAL,
+    INPUT_SILENCE,
+    INPUT_NOISE,
+    INPUT_IMPULSE,
+    INPUT_DC,
+    INPUT_KIND_COUNT
+};
+
+static const char *input_names[INPUT_KIND_COUNT] = {
+    "signal", "silence", "noise", "impulse", "dc"
+};
+
+struct stress_opts {
+    const char *plugin;
+    unsigned long index;
+    unsigned long sample_rate;
+    unsigned long max_block;
+    unsigned int seed;
+    int segments;
+    float segment_secs;
+    float budget_pct;
+    float budget_us;
+};
+
+struct kind_stats {
+    unsigned long blocks;
+    unsigned long samples;
+    unsigned long long ns;
+    double max_ns_per_sample;
+};
+
+struct stress_stats {
+    unsigned long hist[HIST_BUCKETS];
+    struct kind_stats kinds[INPUT_KIND_COUNT];
+    unsigned long blocks;
+    unsigned long over_budget;
+    unsigned long non_finite;
+    unsigned long long max_ns;
+    double max_load;
+    int reports;
+};
+
+static unsigned int rng_state;
+
+static unsigned int rng(void)
+{
+    /* xorshift32 */
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float rng_float(float min, float max)
+{
+    return min + (max - min) * ((rng() >> 8) / (float)(1 << 24));
+}
+
+static int rng_chance(int percent)
+{
+    return (int)(rng() % 100) < percent;
+}
+
+static void randomize_tunings(struct host_instance *inst, int num_tunings)
+{
+    char name[32];
+    float tuning;
+    int i;
+
+    for (i = 0; i < num_tunings; i++) {
+        switch (rng() % 6) {
+            case 0: tuning = 0; break;
+            case 1: tuning = rng_float(1, 40); break;
+            case 2: tuning = rng_float(inst->sample_rate / 4, inst->sample_rate * 1.5f); break;
+            case 3: tuning = inst->sample_rate; break;
+            default: tuning = rng_float(100, 2000); break;
+        }
+        snprintf(name, sizeof(name), "String%d Tuning", i + 1);
+        host_set_control(inst, name, tuning);
+    }
+}
+
+static void randomize_controls(struct host_instance *inst)
+{
+    char name[32];
+    int i;
+
+    host_set_control(inst, "Feedback", rng_chance(40) ? 1.0f : rng_float(0, 1));
+    host_set_control(inst, "Damping", rng_chance(30) ? 0.0f : rng_float(0, 1));
+    host_set_control(inst, "Gain Input", rng_chance(20) ? rng_float(0, 4) : rng_float(0, 0.1f));
+    host_set_control(inst, "Wet Left", rng_float(-0.5f, 1.5f));
+    host_set_control(inst, "Wet Right", rng_float(-0.5f, 1.5f));
+    host_set_control(inst, "Band-pass Low", rng_chance(20) ? 0.0f : rng_float(-10, 2000));
+    host_set_control(inst, "Band-pass High", rng_chance(20) ? 0.0f : rng_float(10, 60000));
+    host_set_control(inst, "Band-pass Mode", rng() % 5);
+    host_set_control(inst, "Decay Mode", rng() % 4);
+    host_set_control(inst, "Decay Time", rng_chance(20) ? 0.0f : rng_float(-1, 60));
+    for (i = 0; i < 11; i++) {
+        snprintf(name, sizeof(name), "String%d Feedback", i + 1);
+        host_set_control(inst, name, rng_chance(20) ? 1.0f : rng_float(0, 1));
+        snprintf(name, sizeof(name), "String%d Damping", i + 1);
+        host_set_control(inst, name, rng_float(0, 1));
+    }
+    host_set_control(inst, "Freeze", rng_chance(20));
+    host_set_control(inst, "Cheap Tail", rng_chance(50));
+}
+
+static unsigned long random_block_size(unsigned long max_block)
+{
+    static const unsigned long odd_sizes[] = { 1, 2, 3, 7, 31, 63, 65, 127, 129, 255, 1023 };
+
+    if (rng_chance(50))
+        return (odd_sizes[rng() % (sizeof(odd_sizes) / sizeof(odd_sizes[0]))] - 1) % max_block + 1;
+    return rng() % max_block + 1;
+}
+
+static void fill_input(struct host_instance *inst, struct host_signal *sig,
+        enum input_kind kind, unsigned long count, unsigned long pos)
+{
+    unsigned long i;
+
+    switch (kind) {
+        case INPUT_SIGNAL:
+            host_signal_fill(sig, inst->input, count, inst->sample_rate);
+            break;
+        case INPUT_SILENCE:
+            memset(inst->input, 0, count * sizeof(LADSPA_Data));
+            break;
+        case INPUT_NOISE:
+            for (i = 0; i < count; i++)
+                inst->input[i] = rng_float(-1, 1);
+            break;
+        case INPUT_IMPULSE:
+            memset(inst->input, 0, count * sizeof(LADSPA_Data));
+            if (pos == 0) inst->input[0] = 1.0f;
+            break;
+        case INPUT_DC:
+            for (i = 0; i < count; i++)
+                inst->input[i] = 1.0f;
+            break;
+        default:
+            break;
+    }
+}
+
+static int check_finite(const struct host_instance *inst, unsigned long count)
+{
+    unsigned long i;
+
+    for (i = 0; i < count; i++) {
+        if (!isfinite(inst->outputs[0][i]) || !isfinite(inst->outputs[1][i]))
+            return 0;
+    }
+    return 1;
+}
+
+static int hist_bucket(unsigned long long ns)
+{
+    int b = 0;
+
+    while (ns > 1 && b < HIST_BUCKETS - 1) {
+        ns >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void report(struct stress_stats *stats, const char *what, int segment,
+        enum input_kind kind, unsigned long count, int add, unsigned long long ns,
+        const struct host_instance *inst)
+{
+    if (stats->reports++ >= MAX_REPORTS) {
+        if (stats->reports == MAX_REPORTS + 1)
+            printf("... further reports suppressed\n");
+        return;
+    }
+    printf("%s: segment %d, %s input, %s, block %lu, %llu ns, "
+            "feedback %.3f, damping %.3f, gain %.3f\n",
+            what, segment, input_names[kind], add ? "run_adding" : "run", count, ns,
+            inst->controls[host_find_port(inst->desc, "Feedback")],
+            inst->controls[host_find_port(inst->desc, "Damping")],
+            inst->controls[host_find_port(inst->desc, "Gain Input")]);
+}
+
+static void run_segment(const struct stress_opts *opts, struct host_instance *inst,
+        struct host_signal *sig, int segment, struct stress_stats *stats)
+{
+    enum input_kind kind = rng() % INPUT_KIND_COUNT;
+    unsigned long remaining = opts->segment_secs * opts->sample_rate;
+    unsigned long pos = 0, count;
+    unsigned long long start, ns;
+    struct kind_stats *ks = &stats->kinds[kind];
+    double budget, load;
+    int add;
+
+    /* tunings, the decimation and the engine are only picked up on
+     * activation */
+    if (rng_chance(30)) {
+        host_deactivate(inst);
+        randomize_tunings(inst, 11);
+        host_set_control(inst, "Decimation", rng() % 5);
+        host_set_control(inst, "Engine", rng() % 2);
+        host_activate(inst);
+    }
+    randomize_controls(inst);
+
+    while (remaining > 0) {
+        count = random_block_size(opts->max_block);
+        if (count > remaining) count = remaining;
+        add = rng_chance(50);
+
+        if (rng_chance(10))
+            randomize_controls(inst);
+        fill_input(inst, sig, kind, count, pos);
+
+        start = host_now_ns();
+        host_run(inst, count, add);
+        ns = host_now_ns() - start;
+
+        budget = opts->budget_us > 0 ? opts->budget_us * 1000
+            : 1e9 * count / opts->sample_rate * opts->budget_pct / 100;
+        load = ns * (double)opts->sample_rate / (1e9 * count);
+
+        stats->blocks++;
+        stats->hist[hist_bucket(ns)]++;
+        if (ns > stats->max_ns) stats->max_ns = ns;
+        if (load > stats->max_load) stats->max_load = load;
+
+        ks->blocks++;
+        ks->samples += count;
+        ks->ns += ns;
+        if ((double)ns / count > ks->max_ns_per_sample)
+            ks->max_ns_per_sample = (double)ns / count;
+
+        if (ns > budget) {
+            stats->over_budget++;
+            report(stats, "over budget", segment, kind, count, add, ns, inst);
+        }
+        if (!check_finite(inst, count)) {
+            stats->non_finite++;
+            report(stats, "non-finite output", segment, kind, count, add, ns, inst);
+        }
+
+        pos += count;
+        remaining -= count;
+    }
+}
+
+static void print_stats(const struct stress_stats *stats)
+{
+    const struct kind_stats *ks;
+    unsigned long max_count = 0;
+    int b, first = -1, last = 0, bar;
+
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        if (stats->hist[b] == 0) continue;
+        if (first < 0) first = b;
+        last = b;
+        if (stats->hist[b] > max_count) max_count = stats->hist[b];
+    }
+
+    printf("\nblock run time histogram (%lu blocks)\n", stats->blocks);
+    for (b = first; b >= 0 && b <= last; b++) {
+        bar = max_count ? (int)(50 * stats->hist[b] / max_count) : 0;
+        if (stats->hist[b] && bar == 0) bar = 1;
+        printf("  < %10llu ns %9lu %.*s\n", 2ULL << b, stats->hist[b], bar,
+                "##################################################");
+    }
+
+    printf("\n%-8s %9s %14s %14s\n", "input", "blocks", "avg ns/sample", "max ns/sample");
+    for (b = 0; b < INPUT_KIND_COUNT; b++) {
+        ks = &stats->kinds[b];
+        if (ks->blocks == 0) continue;
+        printf("%-8s %9lu %14.2f %14.2f\n", input_names[b], ks->blocks,
+                (double)ks->ns / ks->samples, ks->max_ns_per_sample);
+    }
+
+    printf("\nWCET %llu ns, peak load %.1f%% of block duration\n",
+            stats->max_ns, stats->max_load * 100);
+    printf("%lu blocks over budget, %lu blocks with non-finite output\n",
+            stats->over_budget, stats->non_finite);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -p PATH   plugin library (default %s)\n"
+            "  -i INDEX  plugin index in the library (default 0)\n"
+            "  -r RATE   sample rate (default 44100)\n"
+            "  -m SIZE   maximum block size (default 2048)\n"
+            "  -S SEED   random seed (default 1)\n"
+            "  -n COUNT  number of segments (default 200)\n"
+            "  -l SECS   length of each segment (default 0.5)\n"
+            "  -B PCT    budget as percentage of the block duration (default 100)\n"
+            "  -U USECS  absolute budget per block, overrides -B\n",
+            name, HOST_DEFAULT_PLUGIN);
+}
+
+int main(int argc, char **argv)
+{
+    struct stress_opts opts = {
+        .plugin = HOST_DEFAULT_PLUGIN,
+        .sample_rate = 44100,
+        .max_block = 2048,
+        .seed = 1,
+        .segments = 200,
+        .segment_secs = 0.5f,
+        .budget_pct = 100,
+    };
+    struct stress_stats stats;
+    struct host_plugin plugin;
+    struct host_instance inst;
+    struct host_signal sig;
+    int opt, s;
+
+    while ((opt = getopt(argc, argv, "p:i:r:m:S:n:l:B:U:h")) != -1) {
+        switch (opt) {
+            case 'p': opts.plugin = optarg; break;
+            case 'i': opts.index = strtoul(optarg, NULL, 10); break;
+            case 'r': opts.sample_rate = strtoul(optarg, NULL, 10); break;
+            case 'm': opts.max_block = strtoul(optarg, NULL, 10); break;
+            case 'S': opts.seed = strtoul(optarg, NULL, 10); break;
+            case 'n': opts.segments = atoi(optarg); break;
+            case 'l': opts.segment_secs = atof(optarg); break;
+            case 'B': opts.budget_pct = atof(optarg); break;
+            case 'U': opts.budget_us = atof(optarg); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (opts.max_block < 1 || opts.sample_rate < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    rng_state = opts.seed ? opts.seed : 1;
+    memset(&stats, 0, sizeof(stats));
+
+    if (host_load(&plugin, opts.plugin, opts.index))
+        return 1;
+    if (host_instance_init(&inst, &plugin, opts.sample_rate, opts.max_block)) {
+        fprintf(stderr, "Unable to instantiate plugin\n");
+        host_unload(&plugin);
+        return 1;
+    }
+    host_signal_init(&sig, opts.sample_rate);
+    host_activate(&inst);
+
+    printf("plugin %s (%s), %lu Hz, seed %u, %d segments\n",
+            plugin.desc->Label, opts.plugin, opts.sample_rate, opts.seed, opts.segments);
+
+    for (s = 0; s < opts.segments; s++)
+        run_segment(&opts, &inst, &sig, s, &stats);
+
+    print_stats(&stats);
+
+    host_instance_free(&inst);
+    host_unload(&plugin);
+
+    return (stats.over_budget || stats.non_finite) ? 1 : 0;
+}